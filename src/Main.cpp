@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <chrono>
 #include <cstddef>
 #include <cstdlib>
@@ -5,17 +6,25 @@
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include <memory>
 #include <vector>
 
+#include "../src/rtree/builders/CompactRTree.h"
 #include "../src/rtree/builders/RTreeBulkLoad.h"
+#include "../src/rtree/io/IndexFile.h"
+#include "../src/rtree/io/RectangleFile.h"
 
 enum QueryType {
     RANGE = 1,
     NEAREST,
-    JOIN
+    JOIN,
+    NEAREST_JOIN,
+    CONVERT
 };
 
 std::vector<rtree::Rectangle> m_rectangles;
+// A binary dataset is kept mapped and the trees are built straight from its records
+std::unique_ptr<rtree::MappedRectangleFile> m_mappedRectangles;
 std::vector<rtree::Rectangle> rangeQueries;
 std::vector<rtree::Point> nearestQueries;
 
@@ -50,10 +59,17 @@ public:
 void loadData(const std::string &filepath) {
     std::cout << "\n----- R-Tree Spatial Index -----" << std::endl;
     m_rectangles.clear();
+    m_mappedRectangles.reset();
 
     std::filesystem::path pathObj(filepath);
     std::cout << "Filename: " << pathObj.filename() << std::endl;
 
+    // Binary rectangle files are mapped and used without parsing
+    if (rtree::isRectangleFile(filepath)) {
+        m_mappedRectangles = std::make_unique<rtree::MappedRectangleFile>(filepath);
+        return;
+    }
+
     std::ifstream inFile(filepath);
     if (!inFile) {
         std::cerr << "Unable to open file " << filepath << std::endl;
@@ -77,6 +93,15 @@ void loadData(const std::string &filepath) {
     }
 }
 
+// Bulk load a tree from the loaded dataset, reordering m_rectangles
+void buildTree(rtree::RTreeBulkLoad& tree, rtree::ThreadPool& pool) {
+    if (m_mappedRectangles) {
+        tree.bulkLoad(m_mappedRectangles->records(), m_mappedRectangles->size(), pool);
+    } else {
+        tree.bulkLoad(m_rectangles, pool);
+    }
+}
+
 void readRangeQueries(const std::string& filename) {
     std::ifstream file(filename);
 
@@ -134,6 +159,79 @@ void readNearestQueries(const std::string& filename) {
     file.close();
 }
 
+std::unique_ptr<rtree::RTreeBulkLoad> openIndex(const std::string& filepath) {
+    std::cout << "\n----- R-Tree Spatial Index -----" << std::endl;
+    std::filesystem::path pathObj(filepath);
+    std::cout << "Index: " << pathObj.filename() << std::endl;
+
+    Timer time;
+    auto tree = std::make_unique<rtree::RTreeBulkLoad>(filepath);
+    std::cout << "Open Time: " << time.stop() << " sec" << std::endl;
+    return tree;
+}
+
+template<typename CompactTree>
+uint64_t compactRangeQueries(std::unique_ptr<rtree::RTreeBulkLoad>& tree, double& queryTime) {
+    Timer time;
+    CompactTree compact(*tree);
+    std::cout << "Compact Time: " << time.stop() << " sec" << std::endl;
+    std::cout << "Compact Size: " << compact.nodeBytes() << " node bytes, "
+              << compact.rectangleBytes() << " rectangle bytes" << std::endl;
+
+    // The compact copy holds the exact rectangles: the tree and the dataset are no longer needed
+    tree.reset();
+    m_rectangles.clear();
+    m_rectangles.shrink_to_fit();
+    m_mappedRectangles.reset();
+
+    uint64_t totalResults = 0;
+    std::vector<int> results;
+    for (const auto& query : rangeQueries) {
+        results.clear();
+        time.start();
+        totalResults += compact.range(query, results);
+        queryTime += time.stop();
+    }
+    return totalResults;
+}
+
+void printTreeStats(const rtree::TreeStats& stats) {
+    std::cout << "Tree Height: " << stats.height << ", Nodes: " << stats.nodes << ", Entries: " << stats.entries
+              << ", Fill Factor: " << stats.fillFactor << std::endl;
+    std::cout << "Tree Area: " << stats.area << ", Overlap: " << stats.overlap
+              << ", Dead Space: " << stats.deadSpace << std::endl;
+    for (auto level = stats.levels.rbegin(); level != stats.levels.rend(); ++level) {
+        std::cout << "Level " << level->level << ": " << level->nodes << " nodes, " << level->entries
+                  << " entries, fill factor " << level->fillFactor << ", area " << level->area
+                  << ", overlap " << level->overlap << ", dead space " << level->deadSpace << std::endl;
+    }
+    std::cout << "Tree Memory: " << stats.nodeBytes << " header bytes, " << stats.leafArrayBytes
+              << " leaf array bytes, " << stats.internalArrayBytes << " internal array bytes, "
+              << stats.idArrayBytes << " id array bytes (" << stats.unusedSlotBytes << " in unused slots), "
+              << stats.allocatedBytes << " allocated" << std::endl;
+}
+
+#ifdef RTREE_STATS
+void printStats(const rtree::QueryStats& stats) {
+    const double queries = stats.queries > 0 ? static_cast<double>(stats.queries) : 1.0;
+    std::cout << "Stats Queries: " << stats.queries << std::endl;
+    std::cout << "Stats Nodes Visited per Query: " << stats.totalNodesVisited() / queries << " (";
+    const char* separator = "";
+    for (int level = rtree::QueryStats::MAX_LEVELS - 1; level >= 0; level--) {
+        if (stats.nodesVisited[level] == 0) continue;
+        std::cout << separator << "level " << level << ": " << stats.nodesVisited[level] / queries;
+        separator = ", ";
+    }
+    std::cout << ")" << std::endl;
+    std::cout << "Stats Entries Tested per Query: " << stats.entriesTested / queries
+              << ", pruned: " << stats.entriesPruned / queries << std::endl;
+    std::cout << "Stats Contained Subtrees per Query: " << stats.containedSubtrees / queries << std::endl;
+    std::cout << "Stats Heap Operations per Query: " << stats.heapOperations / queries << std::endl;
+    std::cout << "Stats Node Pairs per Query: " << stats.nodePairs / queries << std::endl;
+    std::cout << "Stats Results per Query: " << stats.results / queries << std::endl;
+}
+#endif
+
 int main(int argc, char* argv[]) {
     Timer time;
     double buildTime = 0;
@@ -144,10 +242,20 @@ int main(int argc, char* argv[]) {
     std::string tree_path_b;
     int queryType = -1;
     int k = -1;
+    int threads = 1;
+    bool buildScaling = false;
+    std::string joinOutputFile;
+    std::string indexOutputFile;
+    rtree::BulkLoadMethod method = rtree::BulkLoadMethod::STR;
+    int compactBits = 0;
+    float epsilon = 0.0f;
+    int estimateLevel = -1;
+    int capacity = 64;
+    bool treeReport = false;
 
     // Command-line argument parsing
     char c;
-    while ((c = getopt(argc, argv, "rnjk:")) != -1) {
+    while ((c = getopt(argc, argv, "rnjJk:t:so:Cw:HQ:e:a:c:T")) != -1) {
         switch (c) {
             case 'r':
                 queryType = RANGE;
@@ -161,6 +269,42 @@ int main(int argc, char* argv[]) {
             case 'j':
                 queryType = JOIN;
                 break;
+            case 'J':
+                queryType = NEAREST_JOIN;
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 's':
+                buildScaling = true;
+                break;
+            case 'o':
+                joinOutputFile = optarg;
+                break;
+            case 'C':
+                queryType = CONVERT;
+                break;
+            case 'w':
+                indexOutputFile = optarg;
+                break;
+            case 'H':
+                method = rtree::BulkLoadMethod::HILBERT;
+                break;
+            case 'Q':
+                compactBits = atoi(optarg);
+                break;
+            case 'e':
+                epsilon = static_cast<float>(atof(optarg));
+                break;
+            case 'a':
+                estimateLevel = atoi(optarg);
+                break;
+            case 'c':
+                capacity = atoi(optarg);
+                break;
+            case 'T':
+                treeReport = true;
+                break;
             default:
                 std::cerr << "Invalid arguments!\n";
                 return 1;
@@ -179,34 +323,146 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    if (compactBits != 0 && ((compactBits != 8 && compactBits != 16) || queryType != RANGE)) {
+        std::cerr << "Error: -Q takes 8 or 16 and applies to range queries\n";
+        return 1;
+    }
+
+    if (epsilon < 0.0f || (epsilon > 0.0f && queryType != JOIN)) {
+        std::cerr << "Error: -e takes a non-negative distance and applies to spatial joins\n";
+        return 1;
+    }
+
+    if (capacity < 2) {
+        std::cerr << "Error: -c takes a node capacity of at least 2\n";
+        return 1;
+    }
+
+    if (estimateLevel != -1 && (estimateLevel < 0 || queryType != RANGE || compactBits != 0)) {
+        std::cerr << "Error: -a takes a tree level and applies to range queries on the full tree\n";
+        return 1;
+    }
+
     tree_path_a = filepaths[0];
 
+    // Convert a text dataset to the binary rectangle format
+    if (queryType == CONVERT) {
+        if (rtree::isRectangleFile(tree_path_a)) {
+            std::cerr << "Error: " << tree_path_a << " is already a binary dataset\n";
+            return 1;
+        }
+        loadData(tree_path_a);
+        rtree::writeRectangleFile(filepaths[1], m_rectangles);
+        std::cout << "Converted " << m_rectangles.size() << " rectangles to " << filepaths[1] << std::endl;
+        return 0;
+    }
+
     if (queryType == RANGE || queryType == NEAREST) {
         queryFile = filepaths[1];
     } else {
         tree_path_b = filepaths[1];
     }
 
-    // Load first R-tree
-    loadData(tree_path_a);
-    rtree::RTreeBulkLoad rtreeA(64);
+    // The same workers build the trees and answer the queries
+    rtree::ThreadPool pool(threads);
 
-    time.start();
-    rtreeA.bulkLoad(m_rectangles);
-    buildTime = time.stop();
-    std::cout << "Build Time: " << buildTime << " sec" << std::endl;
+    // Open a persisted first R-tree, or load and build it
+    std::unique_ptr<rtree::RTreeBulkLoad> rtreeA;
+    if (rtree::isIndexFile(tree_path_a)) {
+        rtreeA = openIndex(tree_path_a);
+    } else {
+        time.start();
+        loadData(tree_path_a);
+        std::cout << "Load Time: " << time.stop() << " sec" << std::endl;
+
+        if (buildScaling) {
+            // Rebuild the tree from the unsorted input with 1, 2, 4, ... threads
+            double sequentialTime = 0;
+            for (int workers = 1; ; workers = std::min(workers * 2, pool.size())) {
+                rtree::ThreadPool buildPool(workers);
+                rtree::RTreeBulkLoad scalingTree(capacity, false, method);
+                if (m_mappedRectangles) {
+                    time.start();
+                    buildTree(scalingTree, buildPool);
+                    buildTime = time.stop();
+                } else {
+                    std::vector<rtree::Rectangle> input = m_rectangles;
+                    time.start();
+                    scalingTree.bulkLoad(input, buildPool);
+                    buildTime = time.stop();
+                }
+                if (workers == 1) sequentialTime = buildTime;
+                std::cout << "Build Time (" << workers << " threads): " << buildTime << " sec, speedup "
+                          << sequentialTime / buildTime << "x" << std::endl;
+                if (workers == pool.size()) break;
+            }
+        }
+
+        rtreeA = std::make_unique<rtree::RTreeBulkLoad>(capacity, false, method);
+
+        time.start();
+        buildTree(*rtreeA, pool);
+        buildTime = time.stop();
+        std::cout << "Build Time: " << buildTime << " sec" << std::endl;
+        if (threads != 1) {
+            std::cout << "Threads: " << pool.size() << std::endl;
+        }
+
+        if (!indexOutputFile.empty()) {
+            time.start();
+            rtreeA->save(indexOutputFile);
+            std::cout << "Save Time: " << time.stop() << " sec" << std::endl;
+        }
+    }
+    if (treeReport) {
+        printTreeStats(rtreeA->stats());
+    }
 
     // Handle queries
     if (queryType == RANGE) {
         readRangeQueries(queryFile);
-        for (int i = 0; i < rangeQueries.size(); i++) {
+        uint64_t totalResults = 0;
+        if (estimateLevel >= 0) {
+            // Count estimates only: report their sum and the bounds of the exact total
+            rtree::CountEstimate total{0, 0, 0.0};
+            for (const auto& query : rangeQueries) {
+                time.start();
+                const rtree::CountEstimate estimate = rtreeA->rangeCountEstimate(query, estimateLevel);
+                queryTime += time.stop();
+                total.lower += estimate.lower;
+                total.upper += estimate.upper;
+                total.estimate += estimate.estimate;
+            }
+            std::cout << "Range Estimate Time: " << queryTime << " sec" << std::endl;
+            std::cout << "Range Estimate: " << static_cast<uint64_t>(total.estimate + 0.5)
+                      << " (between " << total.lower << " and " << total.upper << ")" << std::endl;
+            RTREE_STAT(printStats(rtree::RTreeBulkLoad::takeStats()));
+            return 0;
+        }
+        if (compactBits == 8) {
+            totalResults = compactRangeQueries<rtree::CompactRTree8>(rtreeA, queryTime);
+        } else if (compactBits == 16) {
+            totalResults = compactRangeQueries<rtree::CompactRTree16>(rtreeA, queryTime);
+        } else if (threads != 1) {
+            rtree::BatchResults<int> results;
             time.start();
-            rtreeA.range(rangeQueries[i]);
-            queryTime += time.stop();
-            //break;
+            rtreeA->rangeBatch(rangeQueries, results, pool);
+            queryTime = time.stop();
+            totalResults = results.values.size();
+        } else {
+            std::vector<int> results;
+            for (int i = 0; i < rangeQueries.size(); i++) {
+                results.clear();
+                time.start();
+                totalResults += rtreeA->range(rangeQueries[i], results);
+                queryTime += time.stop();
+                //break;
+            }
         }
         std::cout << "Range Query Time: " << queryTime << " sec" << std::endl;
+        std::cout << "Range Query Results: " << totalResults << std::endl;
         //std::cout << "Average Query Time: " << queryTime / (double) rangeQueries.size() << " sec" << std::endl;
+        RTREE_STAT(printStats(rtree::RTreeBulkLoad::takeStats()));
     }
     else if (queryType == NEAREST) {
         if (k <= 0) {
@@ -214,28 +470,76 @@ int main(int argc, char* argv[]) {
             return 1;
         }
         readNearestQueries(queryFile);
-        for (const auto& query : nearestQueries) {
+        uint64_t totalResults = 0;
+        if (threads != 1) {
+            rtree::BatchResults<rtree::Neighbor> results;
             time.start();
-            rtreeA.nearestN(query, k);
-            queryTime += time.stop();
-            //break;
+            rtreeA->nearestBatch(nearestQueries, k, results, pool);
+            queryTime = time.stop();
+            totalResults = results.values.size();
+        } else {
+            std::vector<rtree::Neighbor> neighbors;
+            for (const auto& query : nearestQueries) {
+                neighbors.clear();
+                time.start();
+                totalResults += rtreeA->nearestN(query, k, neighbors);
+                queryTime += time.stop();
+                //break;
+            }
         }
         std::cout << "Nearest Query Time: " << queryTime << " sec" << std::endl;
+        std::cout << "Nearest Query Results: " << totalResults << std::endl;
         //std::cout << "Average Query Time: " << queryTime / (double) nearestQueries.size() << " sec" << std::endl;
+        RTREE_STAT(printStats(rtree::RTreeBulkLoad::takeStats()));
     }
-    else if (queryType == JOIN) {
-        loadData(tree_path_b);
-        rtree::RTreeBulkLoad rtreeB(64);
+    else if (queryType == JOIN || queryType == NEAREST_JOIN) {
+        if (queryType == NEAREST_JOIN && k <= 0) {
+            std::cerr << "Error: Invalid value for k\n";
+            return 1;
+        }
+        std::unique_ptr<rtree::RTreeBulkLoad> rtreeB;
+        if (rtree::isIndexFile(tree_path_b)) {
+            rtreeB = openIndex(tree_path_b);
+        } else {
+            time.start();
+            loadData(tree_path_b);
+            std::cout << "Load Time: " << time.stop() << " sec" << std::endl;
+            rtreeB = std::make_unique<rtree::RTreeBulkLoad>(capacity, false, method);
 
-        time.start();
-        rtreeB.bulkLoad(m_rectangles);
-        buildTime = time.stop();
-        std::cout << "Second RTree Build Time: " << buildTime << " sec" << std::endl;
+            time.start();
+            buildTree(*rtreeB, pool);
+            buildTime = time.stop();
+            std::cout << "Second RTree Build Time: " << buildTime << " sec" << std::endl;
+        }
+        if (treeReport) {
+            printTreeStats(rtreeB->stats());
+        }
+
+        // Stream the pairs to a binary file if requested, otherwise collect them in memory
+        std::unique_ptr<rtree::JoinSink> sink;
+        if (!joinOutputFile.empty()) {
+            sink = std::make_unique<rtree::BinaryFileJoinSink>(joinOutputFile);
+        } else {
+            sink = std::make_unique<rtree::ChunkedJoinBuffer>();
+        }
 
         time.start();
-        rtreeA.join(rtreeB);
+        uint64_t totalResults;
+        if (queryType == NEAREST_JOIN) {
+            totalResults = threads != 1 ? rtreeA->nearestJoin(*rtreeB, k, *sink, pool)
+                                        : rtreeA->nearestJoin(*rtreeB, k, *sink);
+        } else {
+            totalResults = threads != 1 ? rtreeA->distanceJoin(*rtreeB, epsilon, *sink, pool)
+                                        : rtreeA->distanceJoin(*rtreeB, epsilon, *sink);
+        }
+        if (auto* file = dynamic_cast<rtree::BinaryFileJoinSink*>(sink.get())) {
+            file->close();
+        }
         queryTime = time.stop();
-        std::cout << "Join Query Time: " << queryTime << " sec" << std::endl;
+        const char* label = queryType == NEAREST_JOIN ? "Nearest Join" : "Join";
+        std::cout << label << " Query Time: " << queryTime << " sec" << std::endl;
+        std::cout << label << " Query Results: " << totalResults << std::endl;
+        RTREE_STAT(printStats(rtree::RTreeBulkLoad::takeStats()));
     }
     else {
         std::cerr << "Invalid or missing query type.\n";
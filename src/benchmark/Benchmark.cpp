@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../rtree/builders/CompactRTree.h"
+#include "../rtree/builders/RTreeBulkLoad.h"
+#include "../rtree/io/RectangleFile.h"
+#include "Workload.h"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        rtree::Distribution distribution = rtree::Distribution::UNIFORM;
+        std::size_t rectangles = 1000000;
+        std::size_t queries = 10000;
+        double selectivity = 0.0001;
+        int k = 10;
+        int capacity = 64;
+        rtree::BulkLoadMethod method = rtree::BulkLoadMethod::STR;
+        int warmup = 1;
+        int trials = 5;
+        int threads = 1;
+        uint64_t seed = 42;
+        float maxSide = 0.001f;
+        std::vector<std::string> operations{"build", "range", "count", "knn"};
+        bool csv = false;
+        std::string outputFile;
+        std::string datasetFile;
+    };
+
+    /**
+     * Latencies and throughput of one operation over all measured trials.
+     */
+    struct Measurement {
+        std::string operation;
+        /** What the throughput counts: queries, rectangles or joins. */
+        std::string unit;
+        /** Units processed per trial. */
+        uint64_t units = 0;
+        /** Results produced per trial. */
+        uint64_t results = 0;
+        /** Latency of every timed unit of work of every measured trial, in seconds. */
+        std::vector<double> latencies;
+        /** Wall time of all measured trials, in seconds. */
+        double elapsed = 0;
+#ifdef RTREE_STATS
+        /** Traversal counters of all measured trials. */
+        rtree::QueryStats stats;
+        /** Traversal counters of the slowest unit of work. */
+        rtree::QueryStats slowest;
+#endif
+    };
+
+    double seconds(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+#ifdef RTREE_STATS
+    /**
+     * Traversal counters of the operation being measured, and of its slowest unit of work so far.
+     */
+    struct StatsRecord {
+        rtree::QueryStats total;
+        rtree::QueryStats slowest;
+        double slowestLatency = -1;
+    };
+
+    StatsRecord statsRecord;
+#endif
+
+    /**
+     * Records the latency of a unit of work started at start and, when built with RTREE_STATS,
+     * the traversal counters it collected.
+     */
+    void record(std::vector<double>& latencies, Clock::time_point start) {
+        const double latency = seconds(start);
+        latencies.push_back(latency);
+#ifdef RTREE_STATS
+        const rtree::QueryStats stats = rtree::RTreeBulkLoad::takeStats();
+        statsRecord.total += stats;
+        if (latency > statsRecord.slowestLatency) {
+            statsRecord.slowestLatency = latency;
+            statsRecord.slowest = stats;
+        }
+#endif
+    }
+
+    /**
+     * Nearest-rank percentile of sorted latencies, in microseconds.
+     */
+    double percentile(const std::vector<double>& sorted, double p) {
+        if (sorted.empty()) return 0;
+        const auto rank = static_cast<std::size_t>(std::ceil(p / 100.0 * sorted.size()));
+        return sorted[std::min(sorted.size(), std::max<std::size_t>(rank, 1)) - 1] * 1e6;
+    }
+
+    /**
+     * Runs warm-up trials, then measured trials of an operation. run(latencies) performs one
+     * trial, appending the latency of each unit of work it times, and returns its result count.
+     */
+    template<typename Run>
+    Measurement measure(const Options& options, const std::string& operation, const std::string& unit,
+                        uint64_t units, Run&& run) {
+        std::vector<double> discarded;
+        for (int i = 0; i < options.warmup; i++) {
+            discarded.clear();
+            run(discarded);
+        }
+
+        Measurement m{operation, unit, units};
+#ifdef RTREE_STATS
+        statsRecord = StatsRecord();
+#endif
+        for (int i = 0; i < options.trials; i++) {
+            const Clock::time_point start = Clock::now();
+            m.results = run(m.latencies);
+            m.elapsed += seconds(start);
+        }
+        std::sort(m.latencies.begin(), m.latencies.end());
+#ifdef RTREE_STATS
+        m.stats = statsRecord.total;
+        m.slowest = statsRecord.slowest;
+#endif
+        return m;
+    }
+
+    double mean(const std::vector<double>& values) {
+        double total = 0;
+        for (double value : values) total += value;
+        return values.empty() ? 0 : total / values.size() * 1e6;
+    }
+
+    double throughput(const Options& options, const Measurement& m) {
+        return m.elapsed > 0 ? static_cast<double>(m.units) * options.trials / m.elapsed : 0;
+    }
+
+#ifdef RTREE_STATS
+    /**
+     * Writes traversal counters as a JSON object, averaged over the queries they count.
+     */
+    void writeStatsJson(std::ostream& out, const rtree::QueryStats& stats) {
+        const double queries = stats.queries > 0 ? static_cast<double>(stats.queries) : 1.0;
+        out << "{\"queries\": " << stats.queries << ", \"nodesVisited\": [";
+        for (int level = 0; level < rtree::QueryStats::MAX_LEVELS; level++) {
+            out << (level == 0 ? "" : ", ") << stats.nodesVisited[level] / queries;
+        }
+        out << "], \"entriesTested\": " << stats.entriesTested / queries
+            << ", \"entriesPruned\": " << stats.entriesPruned / queries
+            << ", \"containedSubtrees\": " << stats.containedSubtrees / queries
+            << ", \"heapOperations\": " << stats.heapOperations / queries
+            << ", \"nodePairs\": " << stats.nodePairs / queries
+            << ", \"results\": " << stats.results / queries << "}";
+    }
+#endif
+
+    const char* loaderName(rtree::BulkLoadMethod method) {
+        return method == rtree::BulkLoadMethod::HILBERT ? "hilbert" : "str";
+    }
+
+    void writeJson(std::ostream& out, const Options& options, const std::vector<Measurement>& measurements) {
+        out << std::setprecision(6) << "{\n"
+            << "  \"config\": {"
+            << "\"distribution\": \"" << rtree::distributionName(options.distribution) << "\", "
+            << "\"rectangles\": " << options.rectangles << ", "
+            << "\"queries\": " << options.queries << ", "
+            << "\"selectivity\": " << options.selectivity << ", "
+            << "\"k\": " << options.k << ", "
+            << "\"capacity\": " << options.capacity << ", "
+            << "\"loader\": \"" << loaderName(options.method) << "\", "
+            << "\"maxSide\": " << options.maxSide << ", "
+            << "\"seed\": " << options.seed << ", "
+            << "\"warmup\": " << options.warmup << ", "
+            << "\"trials\": " << options.trials << ", "
+            << "\"threads\": " << options.threads << "},\n"
+            << "  \"results\": [";
+        for (std::size_t i = 0; i < measurements.size(); i++) {
+            const Measurement& m = measurements[i];
+            out << (i == 0 ? "\n" : ",\n")
+                << "    {\"operation\": \"" << m.operation << "\", "
+                << "\"unit\": \"" << m.unit << "\", "
+                << "\"units\": " << m.units << ", "
+                << "\"results\": " << m.results << ", "
+                << "\"p50_us\": " << percentile(m.latencies, 50) << ", "
+                << "\"p90_us\": " << percentile(m.latencies, 90) << ", "
+                << "\"p99_us\": " << percentile(m.latencies, 99) << ", "
+                << "\"max_us\": " << percentile(m.latencies, 100) << ", "
+                << "\"mean_us\": " << mean(m.latencies) << ", "
+                << "\"throughput\": " << throughput(options, m);
+#ifdef RTREE_STATS
+            // Counters per query, by node level, and those of the slowest query.
+            out << ", \"stats\": ";
+            writeStatsJson(out, m.stats);
+            out << ", \"slowest\": ";
+            writeStatsJson(out, m.slowest);
+#endif
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    void writeCsv(std::ostream& out, const Options& options, const std::vector<Measurement>& measurements) {
+        // The configuration is repeated on every row, so the output of several runs can be concatenated.
+        out << std::setprecision(6)
+            << "distribution,rectangles,queries,selectivity,k,capacity,loader,seed,operation,unit,units,results,"
+               "p50_us,p90_us,p99_us,max_us,mean_us,throughput\n";
+        for (const Measurement& m : measurements) {
+            out << rtree::distributionName(options.distribution) << ',' << options.rectangles << ','
+                << options.queries << ',' << options.selectivity << ',' << options.k << ','
+                << options.capacity << ',' << loaderName(options.method) << ',' << options.seed << ','
+                << m.operation << ',' << m.unit << ',' << m.units << ',' << m.results << ','
+                << percentile(m.latencies, 50) << ',' << percentile(m.latencies, 90) << ','
+                << percentile(m.latencies, 99) << ',' << percentile(m.latencies, 100) << ','
+                << mean(m.latencies) << ',' << throughput(options, m) << '\n';
+        }
+    }
+
+    std::vector<std::string> split(const std::string& list) {
+        std::vector<std::string> items;
+        std::istringstream stream(list);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            if (!item.empty()) items.push_back(item);
+        }
+        return items;
+    }
+
+    /**
+     * Times every range query of a tree or compact tree individually.
+     */
+    template<typename Tree>
+    uint64_t timeRangeQueries(const Tree& tree, const std::vector<rtree::Rectangle>& queries,
+                              std::vector<int>& results, std::vector<double>& latencies) {
+        uint64_t total = 0;
+        for (const auto& query : queries) {
+            results.clear();
+            const Clock::time_point start = Clock::now();
+            total += tree.range(query, results);
+            record(latencies, start);
+        }
+        return total;
+    }
+
+    void usage() {
+        std::cerr << "Usage: rtree_bench [-d uniform|gaussian|zipf|thin|points] [-n rectangles] [-q queries]\n"
+                     "                   [-s selectivity] [-k neighbours] [-c capacity] [-H] [-m maxSide]\n"
+                     "                   [-w warmup] [-r trials] [-t threads] [-S seed]\n"
+                     "                   [-p build,range,count,knn,join,compact8,compact16]\n"
+                     "                   [-f json|csv] [-o output] [-g dataset.bin]\n";
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+
+    int c;
+    while ((c = getopt(argc, argv, "d:n:q:s:k:c:Hm:w:r:t:S:p:f:o:g:")) != -1) {
+        switch (c) {
+            case 'd':
+                if (!rtree::parseDistribution(optarg, options.distribution)) {
+                    std::cerr << "Error: Unknown distribution " << optarg << "\n";
+                    return 1;
+                }
+                break;
+            case 'n':
+                options.rectangles = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'q':
+                options.queries = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 's':
+                options.selectivity = atof(optarg);
+                break;
+            case 'k':
+                options.k = atoi(optarg);
+                break;
+            case 'c':
+                options.capacity = atoi(optarg);
+                break;
+            case 'H':
+                options.method = rtree::BulkLoadMethod::HILBERT;
+                break;
+            case 'm':
+                options.maxSide = static_cast<float>(atof(optarg));
+                break;
+            case 'w':
+                options.warmup = atoi(optarg);
+                break;
+            case 'r':
+                options.trials = atoi(optarg);
+                break;
+            case 't':
+                options.threads = atoi(optarg);
+                break;
+            case 'S':
+                options.seed = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'p':
+                options.operations = split(optarg);
+                break;
+            case 'f':
+                options.csv = std::string(optarg) == "csv";
+                break;
+            case 'o':
+                options.outputFile = optarg;
+                break;
+            case 'g':
+                options.datasetFile = optarg;
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    if (options.rectangles == 0 || options.queries == 0 || options.trials <= 0 || options.warmup < 0 ||
+        options.capacity < 2 || options.k <= 0 || options.selectivity <= 0 || options.selectivity > 1) {
+        usage();
+        return 1;
+    }
+
+    // Generate the dataset and the queries; every run with the same options sees the same workload.
+    rtree::WorkloadGenerator generator(options.distribution, options.seed, options.maxSide);
+    std::vector<rtree::Rectangle> data;
+    std::vector<rtree::Rectangle> rangeQueries;
+    std::vector<rtree::Point> pointQueries;
+    generator.rectangles(options.rectangles, data);
+    generator.rangeQueries(data, options.queries, options.selectivity, rangeQueries);
+    generator.pointQueries(data, options.queries, pointQueries);
+
+    if (!options.datasetFile.empty()) {
+        rtree::writeRectangleFile(options.datasetFile, data);
+    }
+
+    rtree::ThreadPool pool(options.threads);
+    rtree::RTreeBulkLoad tree(options.capacity, false, options.method);
+    std::vector<rtree::Rectangle> input = data;
+    tree.bulkLoad(input, pool);
+
+    std::vector<Measurement> measurements;
+    std::vector<int> results;
+    std::vector<rtree::Neighbor> neighbors;
+
+    for (const std::string& operation : options.operations) {
+        if (operation == "build") {
+            measurements.push_back(measure(options, operation, "rectangles", data.size(), [&](std::vector<double>& latencies) {
+                input = data;
+                rtree::RTreeBulkLoad built(options.capacity, false, options.method);
+                const Clock::time_point start = Clock::now();
+                built.bulkLoad(input, pool);
+                record(latencies, start);
+                return static_cast<uint64_t>(built.getLeafsSize());
+            }));
+        } else if (operation == "range") {
+            measurements.push_back(measure(options, operation, "queries", rangeQueries.size(), [&](std::vector<double>& latencies) {
+                return timeRangeQueries(tree, rangeQueries, results, latencies);
+            }));
+        } else if (operation == "count") {
+            measurements.push_back(measure(options, operation, "queries", rangeQueries.size(), [&](std::vector<double>& latencies) {
+                uint64_t total = 0;
+                for (const auto& query : rangeQueries) {
+                    const Clock::time_point start = Clock::now();
+                    total += tree.rangeCount(query);
+                    record(latencies, start);
+                }
+                return total;
+            }));
+        } else if (operation == "knn") {
+            measurements.push_back(measure(options, operation, "queries", pointQueries.size(), [&](std::vector<double>& latencies) {
+                uint64_t total = 0;
+                for (const auto& query : pointQueries) {
+                    neighbors.clear();
+                    const Clock::time_point start = Clock::now();
+                    total += tree.nearestN(query, options.k, neighbors);
+                    record(latencies, start);
+                }
+                return total;
+            }));
+        } else if (operation == "join") {
+            // Join against a second dataset of the same distribution and size.
+            rtree::WorkloadGenerator otherGenerator(options.distribution, options.seed + 1, options.maxSide);
+            std::vector<rtree::Rectangle> other;
+            otherGenerator.rectangles(options.rectangles, other);
+            rtree::RTreeBulkLoad otherTree(options.capacity, false, options.method);
+            otherTree.bulkLoad(other, pool);
+
+            measurements.push_back(measure(options, operation, "joins", 1, [&](std::vector<double>& latencies) {
+                const Clock::time_point start = Clock::now();
+                const uint64_t pairs = options.threads != 1 ? tree.joinCount(otherTree, pool) : tree.joinCount(otherTree);
+                record(latencies, start);
+                return pairs;
+            }));
+        } else if (operation == "compact8") {
+            const rtree::CompactRTree8 compact(tree);
+            measurements.push_back(measure(options, operation, "queries", rangeQueries.size(), [&](std::vector<double>& latencies) {
+                return timeRangeQueries(compact, rangeQueries, results, latencies);
+            }));
+        } else if (operation == "compact16") {
+            const rtree::CompactRTree16 compact(tree);
+            measurements.push_back(measure(options, operation, "queries", rangeQueries.size(), [&](std::vector<double>& latencies) {
+                return timeRangeQueries(compact, rangeQueries, results, latencies);
+            }));
+        } else {
+            std::cerr << "Error: Unknown operation " << operation << "\n";
+            return 1;
+        }
+    }
+
+    std::ofstream file;
+    if (!options.outputFile.empty()) {
+        file.open(options.outputFile);
+        if (!file) {
+            std::cerr << "Error: Unable to open " << options.outputFile << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = options.outputFile.empty() ? std::cout : file;
+    if (options.csv) {
+        writeCsv(out, options, measurements);
+    } else {
+        writeJson(out, options, measurements);
+    }
+    return 0;
+}
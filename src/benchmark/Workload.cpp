@@ -0,0 +1,161 @@
+#include "Workload.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace rtree {
+
+    namespace {
+
+        /**
+         * Number of clusters of the Gaussian distribution and their standard deviation.
+         */
+        constexpr int GAUSSIAN_CLUSTERS = 16;
+        constexpr float GAUSSIAN_SIGMA = 0.05f;
+
+        /**
+         * Number of hotspots of the Zipf distribution, the exponent of their popularity and
+         * the standard deviation around each.
+         */
+        constexpr int ZIPF_HOTSPOTS = 1000;
+        constexpr double ZIPF_EXPONENT = 1.0;
+        constexpr float ZIPF_SIGMA = 0.005f;
+
+        /**
+         * Length of a thin rectangle relative to the maximum side length.
+         */
+        constexpr float THIN_ELONGATION = 20.0f;
+
+        struct DistributionName {
+            Distribution distribution;
+            const char* name;
+        };
+
+        constexpr DistributionName DISTRIBUTION_NAMES[] = {
+            {Distribution::UNIFORM, "uniform"},
+            {Distribution::GAUSSIAN, "gaussian"},
+            {Distribution::ZIPF, "zipf"},
+            {Distribution::THIN, "thin"},
+            {Distribution::POINTS, "points"}
+        };
+
+        inline float clampUnit(float value) {
+            return std::min(1.0f, std::max(0.0f, value));
+        }
+    }
+
+    bool parseDistribution(const std::string& name, Distribution& distribution) {
+        for (const auto& entry : DISTRIBUTION_NAMES) {
+            if (name == entry.name) {
+                distribution = entry.distribution;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char* distributionName(Distribution distribution) {
+        for (const auto& entry : DISTRIBUTION_NAMES) {
+            if (entry.distribution == distribution) return entry.name;
+        }
+        return "unknown";
+    }
+
+    WorkloadGenerator::WorkloadGenerator(Distribution distribution, uint64_t seed, float maxSide)
+        : m_distribution(distribution), m_maxSide(maxSide), m_random(seed) {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        if (distribution == Distribution::GAUSSIAN) {
+            for (int i = 0; i < GAUSSIAN_CLUSTERS; i++) {
+                m_centers.emplace_back(unit(m_random), unit(m_random));
+            }
+        } else if (distribution == Distribution::ZIPF) {
+            // Hotspot i is chosen with probability proportional to 1 / (i + 1)^s.
+            double total = 0;
+            for (int i = 0; i < ZIPF_HOTSPOTS; i++) {
+                m_centers.emplace_back(unit(m_random), unit(m_random));
+                total += 1.0 / std::pow(i + 1, ZIPF_EXPONENT);
+                m_zipfCdf.push_back(total);
+            }
+            for (double& p : m_zipfCdf) p /= total;
+        }
+    }
+
+    Point WorkloadGenerator::center() {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        switch (m_distribution) {
+            case Distribution::GAUSSIAN: {
+                std::uniform_int_distribution<int> cluster(0, GAUSSIAN_CLUSTERS - 1);
+                std::normal_distribution<float> offset(0.0f, GAUSSIAN_SIGMA);
+                const Point& c = m_centers[cluster(m_random)];
+                return {clampUnit(c[0] + offset(m_random)), clampUnit(c[1] + offset(m_random))};
+            }
+            case Distribution::ZIPF: {
+                const double p = std::uniform_real_distribution<double>(0.0, 1.0)(m_random);
+                const auto rank = std::lower_bound(m_zipfCdf.begin(), m_zipfCdf.end(), p) - m_zipfCdf.begin();
+                std::normal_distribution<float> offset(0.0f, ZIPF_SIGMA);
+                const Point& c = m_centers[std::min<std::size_t>(rank, m_centers.size() - 1)];
+                return {clampUnit(c[0] + offset(m_random)), clampUnit(c[1] + offset(m_random))};
+            }
+            default:
+                return {unit(m_random), unit(m_random)};
+        }
+    }
+
+    Point WorkloadGenerator::dataCenter(const std::vector<Rectangle>& data) {
+        std::uniform_int_distribution<std::size_t> pick(0, data.size() - 1);
+        const Rectangle& r = data[pick(m_random)];
+        return {(r.min[0] + r.max[0]) / 2, (r.min[1] + r.max[1]) / 2};
+    }
+
+    void WorkloadGenerator::rectangles(std::size_t count, std::vector<Rectangle>& rectangles) {
+        std::uniform_real_distribution<float> side(0.0f, m_maxSide);
+        std::bernoulli_distribution horizontal(0.5);
+
+        rectangles.clear();
+        rectangles.reserve(count);
+        for (std::size_t i = 0; i < count; i++) {
+            const Point c = center();
+            float width = 0;
+            float height = 0;
+            if (m_distribution == Distribution::THIN) {
+                const float length = side(m_random) * THIN_ELONGATION;
+                const float thickness = side(m_random) / THIN_ELONGATION;
+                const bool isHorizontal = horizontal(m_random);
+                width = isHorizontal ? length : thickness;
+                height = isHorizontal ? thickness : length;
+            } else if (m_distribution != Distribution::POINTS) {
+                width = side(m_random);
+                height = side(m_random);
+            }
+            rectangles.emplace_back(c[0] - width / 2, c[1] - height / 2, c[0] + width / 2, c[1] + height / 2,
+                                    static_cast<int>(i + 1));
+        }
+    }
+
+    void WorkloadGenerator::rangeQueries(const std::vector<Rectangle>& data, std::size_t count, double selectivity,
+                                         std::vector<Rectangle>& queries) {
+        const float half = static_cast<float>(std::sqrt(selectivity)) / 2;
+
+        queries.clear();
+        queries.reserve(count);
+        for (std::size_t i = 0; i < count; i++) {
+            const Point c = dataCenter(data);
+            queries.emplace_back(c[0] - half, c[1] - half, c[0] + half, c[1] + half);
+        }
+    }
+
+    void WorkloadGenerator::pointQueries(const std::vector<Rectangle>& data, std::size_t count,
+                                         std::vector<Point>& queries) {
+        std::uniform_real_distribution<float> jitter(-m_maxSide, m_maxSide);
+
+        queries.clear();
+        queries.reserve(count);
+        for (std::size_t i = 0; i < count; i++) {
+            const Point c = dataCenter(data);
+            queries.emplace_back(c[0] + jitter(m_random), c[1] + jitter(m_random));
+        }
+    }
+
+}
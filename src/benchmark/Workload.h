@@ -0,0 +1,128 @@
+#pragma once
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../rtree/structures/Point.h"
+#include "../rtree/structures/Rectangle.h"
+
+namespace rtree {
+
+    /**
+     * Spatial distributions of synthetic datasets. All of them cover the unit square.
+     */
+    enum class Distribution {
+        /** Rectangles centred uniformly at random. */
+        UNIFORM,
+        /** Rectangles around a few Gaussian clusters of equal weight. */
+        GAUSSIAN,
+        /** Rectangles around many small hotspots whose popularity follows a Zipf law. */
+        ZIPF,
+        /** Long, thin horizontal or vertical rectangles, like road or river segments. */
+        THIN,
+        /** Degenerate rectangles of zero extent, centred uniformly at random. */
+        POINTS
+    };
+
+    /**
+     * @brief Parses a distribution name (uniform, gaussian, zipf, thin or points).
+     *
+     * @param name The name.
+     * @param distribution Receives the distribution.
+     * @return False if the name is unknown.
+     */
+    bool parseDistribution(const std::string& name, Distribution& distribution);
+
+    /**
+     * @return The name of a distribution, as accepted by parseDistribution.
+     */
+    const char* distributionName(Distribution distribution);
+
+    /**
+     * Reproducible generator of synthetic datasets and query workloads.
+     *
+     * The same distribution, seed and call sequence always produce the same rectangles and
+     * queries, so benchmark runs can be compared across builds and machines without sharing
+     * any data. Query windows and points are centred on randomly chosen dataset rectangles,
+     * so skewed datasets are queried where their data is.
+     */
+    class WorkloadGenerator {
+
+    public:
+
+        /**
+         * Constructor.
+         * @param distribution The distribution of the rectangles.
+         * @param seed Seed of the random number generator.
+         * @param maxSide Maximum side length of a rectangle; thin rectangles are up to 20 times longer.
+         */
+        WorkloadGenerator(Distribution distribution, uint64_t seed, float maxSide);
+
+        /**
+         * @brief Generates a dataset.
+         *
+         * @param count Number of rectangles.
+         * @param rectangles Receives the rectangles, with ids 1 to count, replacing its contents.
+         */
+        void rectangles(std::size_t count, std::vector<Rectangle>& rectangles);
+
+        /**
+         * @brief Generates square range queries covering a given fraction of the unit square.
+         *
+         * On uniform data the selectivity is also the expected fraction of the dataset each
+         * query returns; on skewed data the queries fall in dense regions and return more.
+         *
+         * @param data The dataset the windows are centred on.
+         * @param count Number of queries.
+         * @param selectivity Area of each window, as a fraction of the unit square.
+         * @param queries Receives the windows, replacing its contents.
+         */
+        void rangeQueries(const std::vector<Rectangle>& data, std::size_t count, double selectivity,
+                          std::vector<Rectangle>& queries);
+
+        /**
+         * @brief Generates k-NN query points at the centres of random dataset rectangles,
+         * jittered by up to one rectangle side.
+         *
+         * @param data The dataset the points are drawn from.
+         * @param count Number of queries.
+         * @param queries Receives the points, replacing its contents.
+         */
+        void pointQueries(const std::vector<Rectangle>& data, std::size_t count, std::vector<Point>& queries);
+
+    private:
+
+        /**
+         * @return A rectangle centre drawn from the distribution.
+         */
+        Point center();
+
+        /**
+         * @return The centre of a rectangle picked uniformly from the dataset.
+         */
+        Point dataCenter(const std::vector<Rectangle>& data);
+
+        const Distribution m_distribution;
+        const float m_maxSide;
+        std::mt19937_64 m_random;
+
+        /**
+         * Centres of the Gaussian clusters or Zipf hotspots.
+         */
+        std::vector<Point> m_centers;
+
+        /**
+         * Cumulative probabilities of the Zipf hotspots, by rank.
+         */
+        std::vector<double> m_zipfCdf;
+    };
+
+}
+
+#endif // WORKLOAD_H
@@ -0,0 +1,265 @@
+#include "CompactRTree.h"
+
+#include <cmath>
+#include <limits>
+
+namespace rtree {
+
+    namespace {
+
+        /**
+         * Quantisation of a coordinate v within a node frame: (v - frameMin) * scale. The same
+         * expression is used for the entries and for the query, so being monotone in v it
+         * preserves every comparison the traversal relies on; the codes of entry minima are
+         * rounded down and those of maxima up.
+         */
+        template<typename Code>
+        inline Code floorCode(float x) {
+            constexpr float top = std::numeric_limits<Code>::max();
+            if (!(x > 0.0f)) return 0;
+            if (x >= top) return std::numeric_limits<Code>::max();
+            return static_cast<Code>(x);
+        }
+
+        template<typename Code>
+        inline Code ceilCode(float x) {
+            constexpr float top = std::numeric_limits<Code>::max();
+            if (!(x < top)) return std::numeric_limits<Code>::max();
+            if (x <= 0.0f) return 0;
+            return static_cast<Code>(std::ceil(x));
+        }
+
+        /**
+         * Codes per unit of a frame extent; 0 for degenerate frames, whose entries then all
+         * share code 0 and are always refined.
+         */
+        template<typename Code>
+        float frameScale(float minimum, float maximum) {
+            const float scale = std::numeric_limits<Code>::max() / (maximum - minimum);
+            return maximum > minimum && std::isfinite(scale) ? scale : 0.0f;
+        }
+
+        /**
+         * Per-thread traversal state reused across queries.
+         */
+        struct CompactScratch {
+            std::vector<int> nodeStack;
+            std::vector<int> boundarySlots;
+            std::vector<int> insideSlots;
+            std::vector<int> leafResults;
+        };
+
+        thread_local CompactScratch compactScratch;
+    }
+
+    template<typename Code>
+    void CompactRTree<Code>::pushCodes(const float* values, int count, float frameMin, float scale, bool roundUp) {
+        for (int i = 0; i < count; i++) {
+            const float x = (values[i] - frameMin) * scale;
+            m_codes.push_back(roundUp ? ceilCode<Code>(x) : floorCode<Code>(x));
+        }
+    }
+
+    template<typename Code>
+    CompactRTree<Code>::CompactRTree(const RTreeBulkLoad& tree) : m_capacity(tree.m_capacity) {
+        const NodeStore& store = tree.m_nodes;
+        std::vector<int> order{tree.m_rootNodeId};
+
+        for (std::size_t q = 0; q < order.size(); q++) {
+            const Node& n = store.node(order[q]);
+            const NodeEntries e = store.entries(n.nodeId);
+
+            CompactNode c{{n.mbrMin[0], n.mbrMin[1]}, {n.mbrMax[0], n.mbrMax[1]},
+                          {frameScale<Code>(n.mbrMin[0], n.mbrMax[0]), frameScale<Code>(n.mbrMin[1], n.mbrMax[1])},
+                          0, n.entryCount, static_cast<int>(m_codes.size()), n.isLeaf()};
+
+            // The codes of a node are contiguous, so a node is filtered from a few cache lines.
+            pushCodes(e.min[0], n.entryCount, c.min[0], c.scale[0], false);
+            pushCodes(e.min[1], n.entryCount, c.min[1], c.scale[1], false);
+            pushCodes(e.max[0], n.entryCount, c.min[0], c.scale[0], true);
+            pushCodes(e.max[1], n.entryCount, c.min[1], c.scale[1], true);
+
+            if (c.leaf) {
+                c.first = static_cast<int>(m_ids.size());
+                for (int i = 0; i < n.entryCount; i++) {
+                    m_boxes.push_back({{e.min[0][i], e.min[1][i]}, {e.max[0][i], e.max[1][i]}});
+                    m_ids.push_back(e.ids[i]);
+                }
+            } else {
+                c.first = static_cast<int>(order.size());
+                order.insert(order.end(), e.ids, e.ids + n.entryCount);
+            }
+            m_nodes.push_back(c);
+        }
+
+        m_codes.resize(m_codes.size() + CODE_PADDING, 0);
+        m_codes.shrink_to_fit();
+        m_nodes.shrink_to_fit();
+        m_boxes.shrink_to_fit();
+        m_ids.shrink_to_fit();
+    }
+
+    template<typename Code>
+    CodeHits CompactRTree<Code>::filterNode(const Rectangle& r, const CompactNode& n, int* boundary, int* inside) const {
+        const Code* codes = m_codes.data() + n.codes;
+        const int count = n.entryCount;
+        return filterCodes(codes, codes + count, codes + 2 * count, codes + 3 * count, count,
+                           floorCode<Code>((r.min[0] - n.min[0]) * n.scale[0]),
+                           floorCode<Code>((r.min[1] - n.min[1]) * n.scale[1]),
+                           ceilCode<Code>((r.max[0] - n.min[0]) * n.scale[0]),
+                           ceilCode<Code>((r.max[1] - n.min[1]) * n.scale[1]),
+                           boundary, inside);
+    }
+
+    template<typename Code>
+    std::pair<int, int> CompactRTree<Code>::rectangleSpan(int nodeId) const {
+        // Every leaf is at the same depth, so the leftmost and rightmost paths bound the span.
+        const CompactNode* first = &m_nodes[nodeId];
+        const CompactNode* last = first;
+        while (!first->leaf) first = &m_nodes[first->first];
+        while (!last->leaf) last = &m_nodes[last->first + last->entryCount - 1];
+        return {first->first, last->first + last->entryCount};
+    }
+
+    template<typename Code>
+    template<typename LeafVisitor, typename ContainedVisitor>
+    void CompactRTree<Code>::rangeTraverse(const Rectangle& r, LeafVisitor&& visit,
+                                           ContainedVisitor&& visitContained) const {
+        std::vector<int>& nodeStack = compactScratch.nodeStack;
+        std::vector<int>& boundarySlots = compactScratch.boundarySlots;
+        std::vector<int>& insideSlots = compactScratch.insideSlots;
+        nodeStack.clear();
+        boundarySlots.resize(m_capacity);
+        insideSlots.resize(m_capacity);
+
+        nodeStack.push_back(0);
+
+        while (!nodeStack.empty()) {
+            const int nodeId = nodeStack.back();
+            const CompactNode& n = m_nodes[nodeId];
+            nodeStack.pop_back();
+
+            // The exact MBR drops children that only the rounding of the codes let through.
+            if (!Rectangle::intersects(r.min.data(), r.max.data(), n.min, n.max)) continue;
+
+            if (Rectangle::contains(r.min.data(), r.max.data(), n.min, n.max)) {
+                const auto [first, end] = rectangleSpan(nodeId);
+                visitContained(first, end);
+                continue;
+            }
+
+            if (n.leaf) {
+                visit(n);
+                continue;
+            }
+
+            const CodeHits hits = filterNode(r, n, boundarySlots.data(), insideSlots.data());
+            for (uint32_t i = 0; i < hits.inside; i++) {
+                const auto [first, end] = rectangleSpan(n.first + insideSlots[i]);
+                visitContained(first, end);
+            }
+            for (uint32_t i = 0; i < hits.boundary; i++) {
+                nodeStack.push_back(n.first + boundarySlots[i]);
+            }
+        }
+    }
+
+    template<typename Code>
+    uint32_t CompactRTree<Code>::refineLeaf(const Rectangle& r, const CompactNode& leaf, int* out) const {
+        int* boundarySlots = compactScratch.boundarySlots.data();
+        int* insideSlots = compactScratch.insideSlots.data();
+        const CodeHits hits = filterNode(r, leaf, boundarySlots, insideSlots);
+        const int* ids = m_ids.data() + leaf.first;
+        uint32_t size = 0;
+        for (uint32_t i = 0; i < hits.inside; i++) {
+            out[size++] = ids[insideSlots[i]];
+        }
+        // Only the entries on the boundary of the range need their exact rectangle.
+        for (uint32_t i = 0; i < hits.boundary; i++) {
+            const int e = leaf.first + boundarySlots[i];
+            const Box& box = m_boxes[e];
+            if (Rectangle::intersects(r.min.data(), r.max.data(), box.min, box.max)) {
+                out[size++] = m_ids[e];
+            }
+        }
+        return size;
+    }
+
+    template<typename Code>
+    uint32_t CompactRTree<Code>::range(const Rectangle& r, std::vector<int>& results) const {
+        const std::size_t start = results.size();
+
+        rangeTraverse(r,
+            [&](const CompactNode& leaf) {
+                std::size_t size = results.size();
+                results.resize(size + leaf.entryCount);
+                size += refineLeaf(r, leaf, results.data() + size);
+                results.resize(size);
+            },
+            [&](int first, int end) {
+                results.insert(results.end(), m_ids.begin() + first, m_ids.begin() + end);
+            });
+        return results.size() - start;
+    }
+
+    template<typename Code>
+    uint32_t CompactRTree<Code>::range(const Rectangle& r, ResultSink& sink) const {
+        std::vector<int>& leafResults = compactScratch.leafResults;
+        leafResults.resize(m_capacity);
+        uint32_t total = 0;
+
+        rangeTraverse(r,
+            [&](const CompactNode& leaf) {
+                const uint32_t hits = refineLeaf(r, leaf, leafResults.data());
+                if (hits > 0) {
+                    sink.accept(leafResults.data(), hits);
+                    total += hits;
+                }
+            },
+            [&](int first, int end) {
+                // Contained rectangles are handed out straight from the id array.
+                sink.accept(m_ids.data() + first, end - first);
+                total += end - first;
+            });
+        return total;
+    }
+
+    template<typename Code>
+    uint64_t CompactRTree<Code>::rangeCount(const Rectangle& r) const {
+        std::vector<int>& boundarySlots = compactScratch.boundarySlots;
+        uint64_t total = 0;
+
+        rangeTraverse(r,
+            [&](const CompactNode& leaf) {
+                const CodeHits hits = filterNode(r, leaf, boundarySlots.data(), nullptr);
+                total += hits.inside;
+                for (uint32_t i = 0; i < hits.boundary; i++) {
+                    const Box& box = m_boxes[leaf.first + boundarySlots[i]];
+                    total += Rectangle::intersects(r.min.data(), r.max.data(), box.min, box.max);
+                }
+            },
+            [&](int first, int end) {
+                total += end - first;
+            });
+        return total;
+    }
+
+    template<typename Code>
+    std::size_t CompactRTree<Code>::nodeBytes() const {
+        return m_nodes.size() * sizeof(CompactNode) + m_codes.size() * sizeof(Code);
+    }
+
+    template<typename Code>
+    std::size_t CompactRTree<Code>::rectangleBytes() const {
+        return m_boxes.size() * sizeof(Box) + m_ids.size() * sizeof(int);
+    }
+
+    template<typename Code>
+    int CompactRTree<Code>::getLeafsSize() const {
+        return static_cast<int>(m_ids.size());
+    }
+
+    template class CompactRTree<uint8_t>;
+    template class CompactRTree<uint16_t>;
+
+}
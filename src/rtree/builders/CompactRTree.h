@@ -0,0 +1,188 @@
+#pragma once
+
+#ifndef COMPACTRTREE_H
+#define COMPACTRTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "RTreeBulkLoad.h"
+
+namespace rtree {
+
+    /**
+     * A read-only, memory-compact copy of an R-tree for range queries.
+     *
+     * The box of every child and leaf entry is stored as Code-sized offsets within the MBR of
+     * its node, rounded outward so that the quantised box always contains the exact one. The
+     * traversal runs on these codes alone; the exact rectangles are kept once, in leaf order,
+     * and only read to refine the candidates of the leaves a query reaches.
+     *
+     * Nodes are numbered breadth-first, so the children of a node, and the rectangles below
+     * it, are contiguous: nodes hold no child ids and leaves no rectangle ids.
+     *
+     * @tparam Code uint8_t or uint16_t.
+     */
+    template<typename Code>
+    class CompactRTree {
+
+    public:
+
+        /**
+         * @brief Builds the compact copy of a tree. The tree is not referenced afterwards.
+         *
+         * @param tree The tree to copy.
+         */
+        explicit CompactRTree(const RTreeBulkLoad& tree);
+
+        /**
+         * @brief Performs a range query.
+         *
+         * @param range The query range.
+         * @param results Vector the ids of the matching entries are appended to.
+         * @return The number of ids appended.
+         */
+        uint32_t range(const Rectangle& range, std::vector<int>& results) const;
+
+        /**
+         * @brief Performs a range query, streaming the results to a sink.
+         *
+         * @param range The query range.
+         * @param sink Receives the ids of the matching entries, one batch per visited leaf or
+         *             contained subtree.
+         * @return The number of ids emitted.
+         */
+        uint32_t range(const Rectangle& range, ResultSink& sink) const;
+
+        /**
+         * @brief Counts the entries intersecting a range. Entries whose quantised box already
+         * lies inside the range are counted without reading their exact rectangle.
+         *
+         * @param range The query range.
+         * @return The number of matching entries.
+         */
+        uint64_t rangeCount(const Rectangle& range) const;
+
+        /**
+         * @return The number of bytes held by the nodes and the entry codes.
+         */
+        [[nodiscard]] std::size_t nodeBytes() const;
+
+        /**
+         * @return The number of bytes held by the exact rectangles.
+         */
+        [[nodiscard]] std::size_t rectangleBytes() const;
+
+        /**
+         * @return the total number of leafs stored in the tree.
+         */
+        int getLeafsSize() const;
+
+    private:
+
+        /**
+         * A node: its exact MBR, which is the frame the codes of its entries are relative to,
+         * and the range of its children or rectangles.
+         */
+        struct CompactNode {
+            float min[2];
+            float max[2];
+            float scale[2];
+            /** First child node, or first rectangle for leaves. */
+            int first;
+            int entryCount;
+            /** Offset of the entry codes: entryCount codes each of the minimum and maximum on x and y. */
+            int codes;
+            bool leaf;
+        };
+
+        /**
+         * An exact rectangle.
+         */
+        struct Box {
+            float min[2];
+            float max[2];
+        };
+
+        /**
+         * @brief Walks the tree for a range query and hands every relevant leaf to the visitor.
+         *
+         * Children whose codes lie strictly inside the query, and nodes whose MBR does, are
+         * handed over as a whole: the rectangles below them are contiguous in breadth-first order.
+         *
+         * @param r The query range.
+         * @param visit Callable invoked as visit(const CompactNode& leaf) for leaves that still
+         *              need to be filtered.
+         * @param visitContained Callable invoked as visitContained(int first, int end) with the
+         *                       rectangles below a node fully inside the range.
+         */
+        template<typename LeafVisitor, typename ContainedVisitor>
+        void rangeTraverse(const Rectangle& r, LeafVisitor&& visit, ContainedVisitor&& visitContained) const;
+
+        /**
+         * @brief Appends the codes of count coordinates along one axis of a node frame to m_codes,
+         * rounded down for minima and up for maxima.
+         */
+        void pushCodes(const float* values, int count, float frameMin, float scale, bool roundUp);
+
+        /**
+         * @brief Quantises the range to the frame of a node and filters the node's entry codes.
+         *
+         * @param r The query range.
+         * @param n The node.
+         * @param boundary Receives the positions of the entries on the boundary of the range.
+         * @param inside Receives the positions of the entries inside the range, or null to count them.
+         */
+        CodeHits filterNode(const Rectangle& r, const CompactNode& n, int* boundary, int* inside) const;
+
+        /**
+         * @brief Writes the ids of the rectangles of a leaf intersecting the range to out,
+         * reading the exact rectangles only for the candidates on the boundary of the range.
+         *
+         * @param r The query range.
+         * @param leaf The leaf.
+         * @param out Output buffer with room for the entries of the leaf.
+         * @return The number of ids written.
+         */
+        uint32_t refineLeaf(const Rectangle& r, const CompactNode& leaf, int* out) const;
+
+        /**
+         * @return The rectangles below a node, as [first, end).
+         */
+        std::pair<int, int> rectangleSpan(int nodeId) const;
+
+        /**
+         * Maximum number of entries per node of the copied tree.
+         */
+        const int m_capacity;
+
+        /**
+         * Nodes in breadth-first order; the root is node 0.
+         */
+        std::vector<CompactNode> m_nodes;
+
+        /**
+         * Entry codes of every node, one block per node, padded by CODE_PADDING codes.
+         */
+        std::vector<Code> m_codes;
+
+        /**
+         * The exact rectangles in leaf order, each leaf's sorted by minX. A refinement reads a
+         * single box, so they are stored as one 16-byte record each.
+         */
+        std::vector<Box> m_boxes;
+
+        /**
+         * The ids of the rectangles, indexed like m_boxes.
+         */
+        std::vector<int> m_ids;
+    };
+
+    using CompactRTree8 = CompactRTree<uint8_t>;
+    using CompactRTree16 = CompactRTree<uint16_t>;
+
+}
+
+#endif // COMPACTRTREE_H
@@ -0,0 +1,93 @@
+#include "HilbertCurve.h"
+
+#include <array>
+#include <cstddef>
+#include <utility>
+
+namespace rtree {
+
+    uint32_t hilbertKey(uint32_t x, uint32_t y) {
+        constexpr uint32_t n = 1u << HILBERT_ORDER;
+        uint32_t key = 0;
+        for (uint32_t s = n / 2; s > 0; s /= 2) {
+            const uint32_t rx = (x & s) > 0;
+            const uint32_t ry = (y & s) > 0;
+            key += s * s * ((3 * rx) ^ ry);
+
+            // Rotate the quadrant so the curve continues in the right orientation.
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = n - 1 - x;
+                    y = n - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return key;
+    }
+
+    uint32_t hilbertKey(uint32_t* cell, int dimensions) {
+        const int order = hilbertOrder(dimensions);
+        const uint32_t top = 1u << (order - 1);
+
+        // Undo the excess work of the inverse transform, from the top bit down.
+        for (uint32_t q = top; q > 1; q >>= 1) {
+            const uint32_t p = q - 1;
+            for (int i = 0; i < dimensions; i++) {
+                if (cell[i] & q) {
+                    cell[0] ^= p;
+                } else {
+                    const uint32_t t = (cell[0] ^ cell[i]) & p;
+                    cell[0] ^= t;
+                    cell[i] ^= t;
+                }
+            }
+        }
+
+        // Gray encode.
+        for (int i = 1; i < dimensions; i++) cell[i] ^= cell[i - 1];
+        uint32_t t = 0;
+        for (uint32_t q = top; q > 1; q >>= 1) {
+            if (cell[dimensions - 1] & q) t ^= q - 1;
+        }
+        for (int i = 0; i < dimensions; i++) cell[i] ^= t;
+
+        // Interleave the bits of the transposed coordinates, most significant first.
+        uint32_t key = 0;
+        for (int bit = order - 1; bit >= 0; bit--) {
+            for (int i = 0; i < dimensions; i++) {
+                key = (key << 1) | ((cell[i] >> bit) & 1);
+            }
+        }
+        return key;
+    }
+
+    void radixSortPairs(std::vector<uint32_t>& keys, std::vector<uint32_t>& values) {
+        const std::size_t count = keys.size();
+        std::vector<uint32_t> keyBuffer(count);
+        std::vector<uint32_t> valueBuffer(count);
+
+        for (int shift = 0; shift < 32; shift += 8) {
+            std::array<std::size_t, 256> offsets{};
+            for (uint32_t key : keys) offsets[(key >> shift) & 0xFF]++;
+
+            // All keys share this byte: the pass would not move anything.
+            if (count == 0 || offsets[(keys[0] >> shift) & 0xFF] == count) continue;
+
+            std::size_t sum = 0;
+            for (auto& offset : offsets) {
+                const std::size_t bucket = offset;
+                offset = sum;
+                sum += bucket;
+            }
+            for (std::size_t i = 0; i < count; i++) {
+                const std::size_t position = offsets[(keys[i] >> shift) & 0xFF]++;
+                keyBuffer[position] = keys[i];
+                valueBuffer[position] = values[i];
+            }
+            keys.swap(keyBuffer);
+            values.swap(valueBuffer);
+        }
+    }
+
+}
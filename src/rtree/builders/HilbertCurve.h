@@ -0,0 +1,57 @@
+#pragma once
+
+#ifndef HILBERTCURVE_H
+#define HILBERTCURVE_H
+
+#include <cstdint>
+#include <vector>
+
+namespace rtree {
+
+    /**
+     * Order of the Hilbert curve used for packing: coordinates are quantised to a grid of
+     * 2^HILBERT_ORDER cells per axis, so keys fit in 32 bits.
+     */
+    constexpr int HILBERT_ORDER = 16;
+
+    /**
+     * @brief Computes the distance of a grid cell along the Hilbert curve.
+     *
+     * @param x Cell column in [0, 2^HILBERT_ORDER).
+     * @param y Cell row in [0, 2^HILBERT_ORDER).
+     * @return The Hilbert key of the cell.
+     */
+    uint32_t hilbertKey(uint32_t x, uint32_t y);
+
+    /**
+     * @brief Number of bits per axis of the Hilbert keys of a grid with the given number of
+     * dimensions: HILBERT_ORDER, or fewer so that the keys still fit in 32 bits.
+     */
+    constexpr int hilbertOrder(int dimensions) {
+        return 32 / dimensions < HILBERT_ORDER ? 32 / dimensions : HILBERT_ORDER;
+    }
+
+    /**
+     * @brief Computes the distance of a cell of a grid with any number of dimensions along the
+     * Hilbert curve, using Skilling's transposition of the axes.
+     *
+     * @param cell The coordinates of the cell, each in [0, 2^hilbertOrder(dimensions)).
+     *             Overwritten by the transposed key.
+     * @param dimensions The number of coordinates.
+     * @return The Hilbert key of the cell.
+     */
+    uint32_t hilbertKey(uint32_t* cell, int dimensions);
+
+    /**
+     * @brief Sorts keys in ascending order with an LSD radix sort, permuting values along.
+     *
+     * The sort is stable and skips the byte passes in which all keys agree.
+     *
+     * @param keys The keys to sort.
+     * @param values The values attached to the keys, same size as keys.
+     */
+    void radixSortPairs(std::vector<uint32_t>& keys, std::vector<uint32_t>& values);
+
+}
+
+#endif // HILBERTCURVE_H
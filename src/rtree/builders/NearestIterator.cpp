@@ -0,0 +1,72 @@
+#include "NearestIterator.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace rtree {
+
+    template<int D, typename T, int Capacity>
+    BasicNearestIterator<D, T, Capacity>::BasicNearestIterator(const Tree& tree) : m_tree(tree) {}
+
+    template<int D, typename T, int Capacity>
+    void BasicNearestIterator<D, T, Capacity>::reset(const Point& p) {
+        for (int d = 0; d < D; d++) {
+            m_point[d] = p[d];
+        }
+        m_nodeQueue.clear();
+        m_entryQueue.clear();
+        m_nodeQueue.emplace_back(0, m_tree.m_rootNodeId);
+    }
+
+    template<int D, typename T, int Capacity>
+    bool BasicNearestIterator<D, T, Capacity>::next(Neighbor& neighbor) {
+        const BasicNodeStore<D, T, Capacity>& nodes = m_tree.m_nodes;
+        const auto further = std::greater<QueueItem>();
+
+        // An entry is returned before a node at the same distance, as the node cannot hold anything nearer.
+        while (!m_nodeQueue.empty() && (m_entryQueue.empty() || m_nodeQueue.front().first < m_entryQueue.front().first)) {
+            std::pop_heap(m_nodeQueue.begin(), m_nodeQueue.end(), further);
+            const int nodeId = m_nodeQueue.back().second;
+            m_nodeQueue.pop_back();
+
+            const BasicNode<D, T>& n = nodes.node(nodeId);
+            const BasicNodeEntries<D, T> e = nodes.entries(nodeId);
+            std::vector<QueueItem>& queue = n.isLeaf() ? m_entryQueue : m_nodeQueue;
+            for (int i = 0; i < n.entryCount; i++) {
+                T min[D];
+                T max[D];
+                for (int d = 0; d < D; d++) {
+                    min[d] = e.min[d][i];
+                    max[d] = e.max[d][i];
+                }
+                queue.emplace_back(BasicRectangle<D, T>::distance(min, max, m_point.data()), e.ids[i]);
+                std::push_heap(queue.begin(), queue.end(), further);
+            }
+        }
+
+        if (m_entryQueue.empty()) {
+            return false;
+        }
+        std::pop_heap(m_entryQueue.begin(), m_entryQueue.end(), further);
+        neighbor = {m_entryQueue.back().second, m_entryQueue.back().first};
+        m_entryQueue.pop_back();
+        return true;
+    }
+
+    template class BasicNearestIterator<2, float>;
+    template class BasicNearestIterator<2, double>;
+    template class BasicNearestIterator<2, int32_t>;
+    template class BasicNearestIterator<3, float>;
+    template class BasicNearestIterator<3, double>;
+    template class BasicNearestIterator<3, int32_t>;
+
+    template class BasicNearestIterator<2, float, 16>;
+    template class BasicNearestIterator<2, float, 32>;
+    template class BasicNearestIterator<2, float, 64>;
+    template class BasicNearestIterator<2, float, 128>;
+    template class BasicNearestIterator<3, float, 16>;
+    template class BasicNearestIterator<3, float, 32>;
+    template class BasicNearestIterator<3, float, 64>;
+    template class BasicNearestIterator<3, float, 128>;
+
+}
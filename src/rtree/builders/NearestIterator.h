@@ -0,0 +1,83 @@
+#pragma once
+
+#ifndef NEARESTITERATOR_H
+#define NEARESTITERATOR_H
+
+#include <array>
+#include <utility>
+#include <vector>
+
+#include "RTreeBulkLoad.h"
+
+namespace rtree {
+
+    /**
+     * Incremental nearest-neighbour search (distance browsing).
+     *
+     * Yields the leaf entries of a tree one at a time in ascending distance from a query point,
+     * so a caller can stop as soon as its own condition is met instead of choosing k up front.
+     * Nodes and leaf entries wait in two min-heaps ordered by distance. The nearest node is
+     * expanded while it is nearer than the nearest entry; otherwise that entry is at least as close as
+     * anything not yet returned and is the next result.
+     *
+     * The heaps are kept between queries, so an iterator reused through reset() performs no heap
+     * allocation once it has grown. The tree must not be modified while an iterator is in use.
+     * The members are defined in NearestIterator.cpp for the instantiations of BasicRTree.
+     */
+    template<int D, typename T, int Capacity = 0>
+    class BasicNearestIterator {
+
+    public:
+
+        using Tree = BasicRTree<D, T, Capacity>;
+        using Point = typename Tree::Point;
+        using Distance = typename Tree::Distance;
+        using Neighbor = typename Tree::Neighbor;
+
+        /**
+         * Constructor.
+         * @param tree The tree to search. It must outlive the iterator.
+         */
+        explicit BasicNearestIterator(const Tree& tree);
+
+        /**
+         * @brief Starts a new search, discarding the state of the previous one.
+         *
+         * @param p The query point.
+         */
+        void reset(const Point& p);
+
+        /**
+         * @brief Advances to the next nearest entry.
+         *
+         * @param neighbor Receives the entry and its squared distance to the query point.
+         * @return False once every entry of the tree has been returned.
+         */
+        bool next(Neighbor& neighbor);
+
+    private:
+
+        /**
+         * A queued node or leaf entry and its distance to the query point.
+         */
+        using QueueItem = std::pair<Distance, int>;
+
+        const Tree& m_tree;
+        std::array<Distance, D> m_point{};
+
+        /**
+         * Min-heap of the nodes still to be expanded.
+         */
+        std::vector<QueueItem> m_nodeQueue;
+
+        /**
+         * Min-heap of the leaf entries of the expanded nodes not yet returned.
+         */
+        std::vector<QueueItem> m_entryQueue;
+    };
+
+    using NearestIterator = BasicNearestIterator<2, float>;
+
+}
+
+#endif // NEARESTITERATOR_H
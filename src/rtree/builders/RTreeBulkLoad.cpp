@@ -1,381 +1,2089 @@
 #include "RTreeBulkLoad.h"
 
+#include <array>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+#include "../parallel/ParallelSort.h"
+#include "../parallel/WorkStealingDeque.h"
+#include "HilbertCurve.h"
+
 namespace rtree {
 
-    RTreeBulkLoad::RTreeBulkLoad(int capacity) : m_capacity(capacity) {}
+    namespace {
+
+        /**
+         * Bounds of a rectangle or rectangle record on an axis.
+         */
+        template<int D, typename T>
+        T lower(const BasicRectangle<D, T>& r, int axis) {
+            return r.min[axis];
+        }
+
+        template<int D, typename T>
+        T upper(const BasicRectangle<D, T>& r, int axis) {
+            return r.max[axis];
+        }
+
+        inline float lower(const RectangleRecord& r, int axis) {
+            return axis == 0 ? r.minX : r.minY;
+        }
+
+        inline float upper(const RectangleRecord& r, int axis) {
+            return axis == 0 ? r.maxX : r.maxY;
+        }
+
+        /**
+         * Centre of a rectangle or rectangle record on an axis, computed as Rectangle::center
+         * does for floating point coordinates and without rounding for integer ones.
+         */
+        template<typename Distance, typename Entry>
+        Distance center(const Entry& r, int axis) {
+            return (static_cast<Distance>(lower(r, axis)) + upper(r, axis)) / 2;
+        }
+
+        /**
+         * Sort order used by the STR packing on an axis: by the minimum on that axis. Ties are
+         * broken on the minima of the other axes, then on the maxima and the id, so that the
+         * order, and therefore the tree, does not depend on the sort algorithm or on the number
+         * of threads building it. In two dimensions the orders are (minX, minY, maxX, maxY, id)
+         * and (minY, minX, maxX, maxY, id).
+         */
+        template<int D, int Axis>
+        struct LessByMin {
+            template<typename Entry>
+            bool operator()(const Entry& a, const Entry& b) const {
+                if (lower(a, Axis) < lower(b, Axis)) return true;
+                if (lower(b, Axis) < lower(a, Axis)) return false;
+                for (int d = 0; d < D; d++) {
+                    if (d == Axis) continue;
+                    if (lower(a, d) < lower(b, d)) return true;
+                    if (lower(b, d) < lower(a, d)) return false;
+                }
+                for (int d = 0; d < D; d++) {
+                    if (upper(a, d) < upper(b, d)) return true;
+                    if (upper(b, d) < upper(a, d)) return false;
+                }
+                return a.id < b.id;
+            }
+        };
+
+        /**
+         * Sort order of node ids used by the STR packing of the upper levels: by the minimum of
+         * the node's MBR on an axis, then by id.
+         */
+        template<typename Store, int Axis>
+        struct LessByMbrMin {
+            const Store& nodes;
+
+            bool operator()(int a, int b) const {
+                return std::make_pair(nodes.node(a).mbrMin[Axis], a) < std::make_pair(nodes.node(b).mbrMin[Axis], b);
+            }
+        };
+
+        /**
+         * Number of nodes per slab when a run of pages nodes is cut into slabs on the first of
+         * the given number of axes: pages^((axes - 1) / axes), rounded up, so that each slab
+         * tiles the remaining axes into as many slabs again.
+         */
+        inline int slabPages(int pages, int axes) {
+            if (axes == 2) return static_cast<int>(std::ceil(std::sqrt(static_cast<double>(pages))));
+            return static_cast<int>(std::ceil(std::pow(static_cast<double>(pages), (axes - 1.0) / axes)));
+        }
+
+        /**
+         * Number of slabs a level of the given number of nodes is cut into on its first axis:
+         * pages^(1 / axes), rounded up.
+         */
+        inline int slabCount(double pages, int axes) {
+            if (axes == 2) return static_cast<int>(std::ceil(std::sqrt(pages)));
+            return static_cast<int>(std::ceil(std::pow(pages, 1.0 / axes)));
+        }
+
+        /**
+         * Orders a slab for the STR packing from the given axis on: sorts it on that axis, cuts
+         * it into slabs of whole nodes and tiles each of them on the next axis. Consecutive runs
+         * of nodeCapacity elements of the slab then form its nodes.
+         *
+         * @param lessOn Callable returning the sort order of an axis, given as an integral_constant.
+         */
+        template<int D, int Axis, typename Iterator, typename LessOn>
+        void tileSlab(Iterator begin, Iterator end, int nodeCapacity, const LessOn& lessOn) {
+            if constexpr (Axis < D) {
+                std::sort(begin, end, lessOn(std::integral_constant<int, Axis>()));
+                const int pages = static_cast<int>((end - begin + nodeCapacity - 1) / nodeCapacity);
+                const std::ptrdiff_t slabSize = static_cast<std::ptrdiff_t>(slabPages(pages, D - Axis)) * nodeCapacity;
+                for (Iterator slab = begin; slab < end; ) {
+                    const Iterator slabEnd = slab + std::min(slabSize, end - slab);
+                    tileSlab<D, Axis + 1>(slab, slabEnd, nodeCapacity, lessOn);
+                    slab = slabEnd;
+                }
+            }
+        }
 
-    void RTreeBulkLoad::bulkLoad(std::vector<Rectangle>& rectangles) {
+        /**
+         * Number of nodes each STR slab packs into, as prefix sums: slab g fills the nodes
+         * [first[g], first[g + 1]). Knowing this up front lets the slabs be packed concurrently
+         * into node ids identical to a sequential build.
+         */
+        std::vector<int> slabNodeOffsets(int total, int numGroups, int groupSize, int nodeCapacity) {
+            std::vector<int> first(numGroups + 1, 0);
+            for (int g = 0; g < numGroups; g++) {
+                const int start = g * groupSize;
+                const int size = std::max(0, std::min(start + groupSize, total) - start);
+                first[g + 1] = first[g] + (size + nodeCapacity - 1) / nodeCapacity;
+            }
+            return first;
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    BasicRTree<D, T, Capacity>::BasicRTree(int capacity, bool hugePages, BulkLoadMethod method)
+        : m_nodes(capacity, hugePages), m_capacity(m_nodes.capacity()), m_method(method) {}
+
+    template<int D, typename T, int Capacity>
+    BasicRTree<D, T, Capacity>::BasicRTree(const std::string& indexPath)
+        : BasicRTree(std::make_shared<MappedIndexFile>(indexPath)) {}
+
+    template<int D, typename T, int Capacity>
+    BasicRTree<D, T, Capacity>::BasicRTree(std::shared_ptr<MappedIndexFile> image)
+        : m_nodes(image->header().capacity), m_capacity(m_nodes.capacity()), m_image(std::move(image)) {
+        const IndexFileHeader& header = m_image->header();
+        if (header.dimensions != D || header.coordinateType != coordinateTypeCode<T>()) {
+            throw std::runtime_error("Invalid or incompatible index file: other dimensions or coordinate type");
+        }
+        if (header.nodeSize != NodeStore::nodeBytes()) {
+            throw std::runtime_error("Invalid or incompatible index file: unexpected node size");
+        }
+        m_nodes.attach(m_image->image(), header.nodeCount);
+        if (m_nodes.allocatedBytes() != header.imageBytes) {
+            throw std::runtime_error("Invalid or incompatible index file: unexpected image size");
+        }
+        m_rootNodeId = header.rootNodeId;
+        treeHeight = header.treeHeight;
+        m_totalRectangles = header.totalRectangles;
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::save(const std::string& path) const {
+        IndexFileHeader header{};
+        header.nodeSize = NodeStore::nodeBytes();
+        header.capacity = m_nodes.capacity();
+        header.nodeCount = m_nodes.imageSize();
+        header.rootNodeId = m_nodes.imageNodeId(m_rootNodeId);
+        header.treeHeight = treeHeight;
+        header.totalRectangles = m_totalRectangles;
+        header.dimensions = D;
+        header.coordinateType = coordinateTypeCode<T>();
+        header.imageBytes = m_nodes.imageBytes();
+        writeIndexFile(path, header, [this](std::FILE* file) { return m_nodes.writeImage(file); });
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::bulkLoad(std::vector<Rectangle>& rectangles) {
+        ThreadPool sequential(1);
+        bulkLoad(rectangles, sequential);
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::bulkLoad(std::vector<Rectangle>& rectangles, ThreadPool& pool) {
+        build(rectangles, pool);
+    }
+
+    template<int D, typename T, int Capacity>
+    template<int Dims, typename Coordinate, typename>
+    void BasicRTree<D, T, Capacity>::bulkLoad(const RectangleRecord* records, std::size_t count) {
+        ThreadPool sequential(1);
+        bulkLoad(records, count, sequential);
+    }
+
+    template<int D, typename T, int Capacity>
+    template<int Dims, typename Coordinate, typename>
+    void BasicRTree<D, T, Capacity>::bulkLoad(const RectangleRecord* records, std::size_t count, ThreadPool& pool) {
+        // The packing sorts in place and the records may be a read-only mapping.
+        std::vector<RectangleRecord> buffer(records, records + count);
+        build(buffer, pool);
+    }
+
+    template<int D, typename T, int Capacity>
+    template<typename Entry>
+    void BasicRTree<D, T, Capacity>::build(std::vector<Entry>& rectangles, ThreadPool& pool) {
         m_totalRectangles = static_cast<int>(rectangles.size());
-        auto leafNodes = createLeafLevel(rectangles, m_capacity);
-        std::vector<Node*> currentLevel = leafNodes;
+        m_nodes.clear();
+        m_nodes.reserve(estimateNodeCount(m_totalRectangles));
+        m_image.reset();
+
+        const bool hilbert = m_method == BulkLoadMethod::HILBERT;
+        auto leafNodes = hilbert ? createHilbertLeafLevel(rectangles, m_capacity, pool)
+                                 : createLeafLevel(rectangles, m_capacity, pool);
+        std::vector<int> currentLevel = leafNodes;
         int currentHeight = 1;
 
         while (currentLevel.size() > m_capacity) {
-            currentLevel = createNextLevel(currentLevel, m_capacity);
+            currentLevel = hilbert ? packNextLevel(currentLevel, m_capacity, pool)
+                                   : createNextLevel(currentLevel, m_capacity, pool);
             currentHeight++;
         }
 
-        if (currentLevel.size() == 1) {
-            m_root = currentLevel.front();
-            m_rootNodeId = m_root->nodeId;
+        if (currentLevel.empty()) {
+            // Empty dataset: a single empty leaf keeps every query well-defined.
+            m_rootNodeId = m_nodes.createNode(1);
+            treeHeight = 1;
+        } else if (currentLevel.size() == 1) {
+            m_rootNodeId = currentLevel.front();
             treeHeight = currentHeight;
         } else {
-            m_root = createNode(currentLevel, currentHeight + 1);
-            m_rootNodeId = m_root->nodeId;
+            m_rootNodeId = m_nodes.allocateNodes(1);
+            createNode(currentLevel.begin(), currentLevel.end(), currentHeight + 1, m_rootNodeId);
             treeHeight = currentHeight + 1;
         }
     }
 
-    std::vector<Node*> RTreeBulkLoad::createLeafLevel(std::vector<Rectangle>& rectangles, int nodeCapacity) {
-        std::vector<Node*> leafNodes;
+    template<int D, typename T, int Capacity>
+    template<typename Entry>
+    std::vector<int> BasicRTree<D, T, Capacity>::createLeafLevel(std::vector<Entry>& rectangles, int nodeCapacity,
+                                                       ThreadPool& pool) {
+        std::vector<int> leafNodes;
+
+        // Initial sort on the first axis (rough ordering)
+        parallelSort(rectangles.begin(), rectangles.end(), LessByMin<D, 0>(), pool);
 
-        // Initial sort by minX (rough ordering)
-        std::sort(rectangles.begin(), rectangles.end(),
-              [](const Rectangle& a, const Rectangle& b) {
-                  return a.minX < b.minX;
-              });
+        if (m_totalRectangles == 0) return leafNodes;
 
         int numOfLeafs = std::ceil(m_totalRectangles / (double) nodeCapacity);
-        int numGroups = (numOfLeafs / (double) std::sqrt(numOfLeafs));
-        int groupSize = std::ceil((double)std::sqrt(numOfLeafs))*nodeCapacity;
+        int groupSize = slabPages(numOfLeafs, D) * nodeCapacity;
+        int numGroups = std::ceil(m_totalRectangles / (double) groupSize);
 
-        for (int j = 0; j < numGroups; j++) {
-            int start = j * groupSize;
-            int end = std::min(start + groupSize, m_totalRectangles);
+        const std::vector<int> firstLeaf = slabNodeOffsets(m_totalRectangles, numGroups, groupSize, nodeCapacity);
+        const int firstId = m_nodes.allocateNodes(firstLeaf[numGroups]);
+        leafNodes.resize(firstLeaf[numGroups]);
+        const auto lessOn = [](auto axis) { return LessByMin<D, decltype(axis)::value>(); };
 
-            // Secondary sort by minY to group spatially
-            std::sort(rectangles.begin() + start, rectangles.begin() + end,
-                  [](const Rectangle& a, const Rectangle& b) {
-                      return a.minY < b.minY;
-                  });
+        // Slabs are independent: sort and pack them concurrently.
+        pool.parallelFor(numGroups, 1, [&](std::size_t begin, std::size_t end, int) {
+            for (int j = static_cast<int>(begin); j < static_cast<int>(end); j++) {
+                int start = j * groupSize;
+                int slabEnd = std::min(start + groupSize, m_totalRectangles);
 
-            // Now, partition the group into leaf nodes
-            for (int i = start; i < end; i += nodeCapacity) {
-                int nodeEnd = std::min(i + nodeCapacity, end);
-                auto node = createLeafNode(rectangles, i, nodeEnd);
-                leafNodes.push_back(node);
+                // Tile the slab on the remaining axes to group spatially
+                tileSlab<D, 1>(rectangles.begin() + start, rectangles.begin() + slabEnd, nodeCapacity, lessOn);
+
+                // Now, partition the group into leaf nodes
+                int leaf = firstLeaf[j];
+                for (int i = start; i < slabEnd; i += nodeCapacity, leaf++) {
+                    int nodeEnd = std::min(i + nodeCapacity, slabEnd);
+                    leafNodes[leaf] = firstId + leaf;
+                    createLeafNode(rectangles, i, nodeEnd, firstId + leaf);
+                }
             }
-        }
+        });
         return leafNodes;
     }
 
-    std::vector<Node*> RTreeBulkLoad::createNextLevel(std::vector<Node*>& nodes, int nodeCapacity) {
-        std::vector<Node*> parentNodes;
+    template<int D, typename T, int Capacity>
+    std::vector<int> BasicRTree<D, T, Capacity>::createNextLevel(std::vector<int>& nodes, int nodeCapacity, ThreadPool& pool) {
+        std::vector<int> parentNodes;
         int totalNodes = static_cast<int>(nodes.size());
 
         if (totalNodes == 0) return parentNodes;
 
-        // Primary sort by the x-coordinate of the MBR.
-        std::sort(nodes.begin(), nodes.end(),
-                  [](const Node* a, const Node* b) {
-                      return a->mbrMinX < b->mbrMinX;
-                  });
+        // Primary sort by the minimum of the MBR on the first axis.
+        parallelSort(nodes.begin(), nodes.end(), LessByMbrMin<NodeStore, 0>{m_nodes}, pool);
 
-        int numGroups = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(totalNodes) / nodeCapacity)));
+        int numGroups = slabCount(static_cast<double>(totalNodes) / nodeCapacity, D);
         int groupSize = (totalNodes + numGroups - 1) / numGroups;
 
-        for (int g = 0; g < numGroups; g++) {
-            int start = g * groupSize;
-            int end = std::min(start + groupSize, totalNodes);
+        const std::vector<int> firstParent = slabNodeOffsets(totalNodes, numGroups, groupSize, nodeCapacity);
+        const int firstId = m_nodes.allocateNodes(firstParent[numGroups]);
+        const int childLevel = m_nodes.node(nodes.front()).level;  // All children have the same level
+        parentNodes.resize(firstParent[numGroups]);
+        const auto lessOn = [this](auto axis) { return LessByMbrMin<NodeStore, decltype(axis)::value>{m_nodes}; };
 
-            // Secondary sort by minY for grouping.
-            std::sort(nodes.begin() + start, nodes.begin() + end,
-                  [](const Node* a, const Node* b) {
-                      return a->mbrMinY < b->mbrMinY;
-                  });
+        pool.parallelFor(numGroups, 1, [&](std::size_t begin, std::size_t end, int) {
+            for (int g = static_cast<int>(begin); g < static_cast<int>(end); g++) {
+                int start = g * groupSize;
+                int slabEnd = std::min(start + groupSize, totalNodes);
 
-            // Now, for each parent node, re-sort its entries by minX.
-            for (int i = start; i < end; i += nodeCapacity) {
-                int nodeEnd = std::min(i + nodeCapacity, end);
-                std::vector<Node*> children(nodes.begin() + i, nodes.begin() + nodeEnd);
-                int childLevel = children.front()->level;  // All children have the same level
-                auto parent = createNode(children, childLevel + 1);
-                parentNodes.push_back(parent);
+                // Tile the slab on the remaining axes for grouping.
+                tileSlab<D, 1>(nodes.begin() + start, nodes.begin() + slabEnd, nodeCapacity, lessOn);
+
+                // Now, for each parent node, re-sort its entries on the first axis.
+                int parent = firstParent[g];
+                for (int i = start; i < slabEnd; i += nodeCapacity, parent++) {
+                    int nodeEnd = std::min(i + nodeCapacity, slabEnd);
+                    parentNodes[parent] = firstId + parent;
+                    createNode(nodes.begin() + i, nodes.begin() + nodeEnd, childLevel + 1, firstId + parent);
+                }
+            }
+        });
+        return parentNodes;
+    }
+
+    template<int D, typename T, int Capacity>
+    template<typename Entry>
+    std::vector<int> BasicRTree<D, T, Capacity>::createHilbertLeafLevel(std::vector<Entry>& rectangles, int nodeCapacity,
+                                                              ThreadPool& pool) {
+        const std::size_t count = rectangles.size();
+        if (count == 0) return {};
+
+        // Quantise the rectangle centres over the bounds of all centres.
+        std::array<Distance, D> low;
+        std::array<Distance, D> high;
+        low.fill(std::numeric_limits<Distance>::max());
+        high.fill(std::numeric_limits<Distance>::lowest());
+        for (const auto& r : rectangles) {
+            for (int d = 0; d < D; d++) {
+                const Distance c = center<Distance>(r, d);
+                low[d] = std::min(low[d], c);
+                high[d] = std::max(high[d], c);
             }
         }
+        const double cells = (1u << hilbertOrder(D)) - 1;
+        std::array<double, D> scale;
+        for (int d = 0; d < D; d++) {
+            scale[d] = high[d] > low[d] ? cells / (static_cast<double>(high[d]) - low[d]) : 0;
+        }
+
+        std::vector<uint32_t> keys(count);
+        std::vector<uint32_t> order(count);
+        pool.parallelFor(count, 1 << 14, [&](std::size_t begin, std::size_t end, int) {
+            std::array<uint32_t, D> cell;
+            for (std::size_t i = begin; i < end; i++) {
+                for (int d = 0; d < D; d++) {
+                    cell[d] = static_cast<uint32_t>((center<Distance>(rectangles[i], d) - low[d]) * scale[d]);
+                }
+                if constexpr (D == 2) {
+                    keys[i] = hilbertKey(cell[0], cell[1]);
+                } else {
+                    keys[i] = hilbertKey(cell.data(), D);
+                }
+                order[i] = static_cast<uint32_t>(i);
+            }
+        });
+        radixSortPairs(keys, order);
+
+        std::vector<Entry> sorted;
+        sorted.reserve(count);
+        for (uint32_t i : order) sorted.push_back(std::move(rectangles[i]));
+        rectangles.swap(sorted);
+
+        // Pack the leaves in key order.
+        const int numLeafs = static_cast<int>((count + nodeCapacity - 1) / nodeCapacity);
+        const int firstId = m_nodes.allocateNodes(numLeafs);
+        std::vector<int> leafNodes(numLeafs);
+        pool.parallelFor(numLeafs, 64, [&](std::size_t begin, std::size_t end, int) {
+            for (int leaf = static_cast<int>(begin); leaf < static_cast<int>(end); leaf++) {
+                const int start = leaf * nodeCapacity;
+                leafNodes[leaf] = firstId + leaf;
+                createLeafNode(rectangles, start, std::min(start + nodeCapacity, m_totalRectangles), firstId + leaf);
+            }
+        });
+        return leafNodes;
+    }
+
+    template<int D, typename T, int Capacity>
+    std::vector<int> BasicRTree<D, T, Capacity>::packNextLevel(const std::vector<int>& nodes, int nodeCapacity, ThreadPool& pool) {
+        const int totalNodes = static_cast<int>(nodes.size());
+        const int numParents = (totalNodes + nodeCapacity - 1) / nodeCapacity;
+        const int firstId = m_nodes.allocateNodes(numParents);
+        const int childLevel = m_nodes.node(nodes.front()).level;
+
+        std::vector<int> parentNodes(numParents);
+        pool.parallelFor(numParents, 64, [&](std::size_t begin, std::size_t end, int) {
+            for (int parent = static_cast<int>(begin); parent < static_cast<int>(end); parent++) {
+                const int start = parent * nodeCapacity;
+                const int stop = std::min(start + nodeCapacity, totalNodes);
+                parentNodes[parent] = firstId + parent;
+                createNode(nodes.begin() + start, nodes.begin() + stop, childLevel + 1, firstId + parent);
+            }
+        });
         return parentNodes;
     }
 
-    Node* RTreeBulkLoad::createNode(std::vector<Node*>& children, int level) {
-        auto node = new Node(getNextNodeId(), level, m_capacity);
-        for (const auto child : children) {
-            node->addChildEntry(child);
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::createNode(std::vector<int>::const_iterator begin, std::vector<int>::const_iterator end,
+                                      int level, int nodeId) {
+        m_nodes.initNode(nodeId, level);
+        for (auto child = begin; child != end; ++child) {
+            m_nodes.addChildEntry(nodeId, *child);
         }
-        node->sortChildrenByMinX();
-        return node;
+        m_nodes.sortEntriesByMinX(nodeId);
     }
 
-    Node* RTreeBulkLoad::createLeafNode(const std::vector<Rectangle>& rectangles, int start, int end) {
-        auto node = new Node(getNextNodeId(), 1, m_capacity);
+    template<int D, typename T, int Capacity>
+    template<typename Entry>
+    void BasicRTree<D, T, Capacity>::createLeafNode(const std::vector<Entry>& rectangles, int start, int end, int nodeId) {
+        m_nodes.initNode(nodeId, 1);
+        std::array<T, D> min;
+        std::array<T, D> max;
         for (int i = start; i < end; i++) {
-            node->addLeafEntry(rectangles[i]);
+            const Entry& r = rectangles[i];
+            for (int d = 0; d < D; d++) {
+                min[d] = lower(r, d);
+                max[d] = upper(r, d);
+            }
+            m_nodes.addLeafEntry(nodeId, min.data(), max.data(), r.id);
         }
-        node->sortLeafsByMinX();
-        return node;
+        m_nodes.sortEntriesByMinX(nodeId);
     }
 
-    int RTreeBulkLoad::getNextNodeId() {
-        return m_nextNodeId++;
+    template<int D, typename T, int Capacity>
+    int BasicRTree<D, T, Capacity>::estimateNodeCount(int rectangleCount) const {
+        if (m_method == BulkLoadMethod::HILBERT) {
+            // Every level packs full nodes in order.
+            int levelNodes = std::max(1, (rectangleCount + m_capacity - 1) / m_capacity);
+            int total = levelNodes;
+            while (levelNodes > m_capacity) {
+                levelNodes = (levelNodes + m_capacity - 1) / m_capacity;
+                total += levelNodes;
+            }
+            return total + 1;
+        }
+
+        // Mirrors the slab arithmetic of createLeafLevel and createNextLevel.
+        int numOfLeafs = std::ceil(rectangleCount / (double) m_capacity);
+        if (numOfLeafs == 0) return 1;
+
+        int groupSize = slabPages(numOfLeafs, D) * m_capacity;
+        int numGroups = std::ceil(rectangleCount / (double) groupSize);
+        int levelNodes = slabNodeOffsets(rectangleCount, numGroups, groupSize, m_capacity)[numGroups];
+        int total = levelNodes;
+
+        while (levelNodes > m_capacity) {
+            numGroups = slabCount(static_cast<double>(levelNodes) / m_capacity, D);
+            groupSize = (levelNodes + numGroups - 1) / numGroups;
+            levelNodes = slabNodeOffsets(levelNodes, numGroups, groupSize, m_capacity)[numGroups];
+            total += levelNodes;
+        }
+        // A separate root is created above the last level if it holds more than one node.
+        return total + 1;
     }
 
-    int RTreeBulkLoad::getLeafsSize() const {
+    // Updates
+
+    namespace {
+
+        /**
+         * Fraction of the capacity below which a node modified by a removal is dissolved,
+         * and the minimum fill of either group of a split.
+         */
+        constexpr double MIN_FILL_RATIO = 0.4;
+
+        /**
+         * Fraction of the capacity removed from an overflowing node for a forced reinsert.
+         */
+        constexpr double REINSERT_RATIO = 0.3;
+
+        template<int D, typename T>
+        DistanceType<T> area(const BasicRectangle<D, T>& e) {
+            return e.volume();
+        }
+
+        template<int D, typename T>
+        DistanceType<T> margin(const BasicRectangle<D, T>& e) {
+            DistanceType<T> total = 0;
+            for (int d = 0; d < D; d++) {
+                total += static_cast<DistanceType<T>>(e.max[d]) - e.min[d];
+            }
+            return total;
+        }
+
+        template<int D, typename T>
+        BasicRectangle<D, T> unite(const BasicRectangle<D, T>& a, const BasicRectangle<D, T>& b) {
+            BasicRectangle<D, T> united;
+            for (int d = 0; d < D; d++) {
+                united.min[d] = std::min(a.min[d], b.min[d]);
+                united.max[d] = std::max(a.max[d], b.max[d]);
+            }
+            united.id = a.id;
+            return united;
+        }
+
+        template<int D, typename T>
+        DistanceType<T> overlap(const BasicRectangle<D, T>& a, const BasicRectangle<D, T>& b) {
+            DistanceType<T> total = 1;
+            for (int d = 0; d < D; d++) {
+                const DistanceType<T> extent = static_cast<DistanceType<T>>(std::min(a.max[d], b.max[d]))
+                                               - std::max(a.min[d], b.min[d]);
+                if (extent <= 0) return 0;
+                total *= extent;
+            }
+            return total;
+        }
+
+        /**
+         * @return Entry i of a node, copied out of its entry arrays.
+         */
+        template<int D, typename T>
+        BasicRectangle<D, T> entryAt(const BasicNodeEntries<D, T>& e, int i) {
+            BasicRectangle<D, T> entry;
+            for (int d = 0; d < D; d++) {
+                entry.min[d] = e.min[d][i];
+                entry.max[d] = e.max[d][i];
+            }
+            entry.id = e.ids[i];
+            return entry;
+        }
+
+        /**
+         * @return The node's MBR as an entry of its parent.
+         */
+        template<typename Store>
+        typename Store::Rectangle entryOf(const Store& nodes, int nodeId) {
+            const typename Store::Node& n = nodes.node(nodeId);
+            return {n.mbrMin, n.mbrMax, nodeId};
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::insert(const Rectangle& rectangle) {
+        if (m_nodes.size() == 0) {
+            // Never bulk loaded: start from an empty leaf root.
+            m_rootNodeId = m_nodes.createNode(1);
+            treeHeight = 1;
+        }
+        std::vector<bool> reinserted(treeHeight + 1, false);
+        insertEntry(rectangle, 1, reinserted);
+        m_totalRectangles++;
+    }
+
+    template<int D, typename T, int Capacity>
+    bool BasicRTree<D, T, Capacity>::remove(int id, const Rectangle& mbr) {
+        if (m_nodes.size() == 0) return false;
+
+        std::vector<int> path;
+        const int slot = findLeaf(id, mbr, path);
+        if (slot < 0) return false;
+
+        m_nodes.deleteEntry(path.back(), slot);
+        condenseTree(path);
+        m_totalRectangles--;
+        return true;
+    }
+
+    template<int D, typename T, int Capacity>
+    int BasicRTree<D, T, Capacity>::minEntries() const {
+        return std::max(1, static_cast<int>(m_capacity * MIN_FILL_RATIO));
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::insertEntry(const Rectangle& entry, int level, std::vector<bool>& reinserted) {
+        std::vector<int> path;
+        chooseSubtree(entry, level, path);
+        addToPath(path, entry, reinserted);
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::chooseSubtree(const Rectangle& entry, int level, std::vector<int>& path) const {
+        path.clear();
+        int nodeId = m_rootNodeId;
+        path.push_back(nodeId);
+
+        while (m_nodes.node(nodeId).level > level) {
+            const Node& n = m_nodes.node(nodeId);
+            const NodeEntries e = m_nodes.entries(nodeId);
+
+            int best = 0;
+            Distance bestOverlap = std::numeric_limits<Distance>::max();
+            Distance bestEnlargement = std::numeric_limits<Distance>::max();
+            Distance bestArea = std::numeric_limits<Distance>::max();
+            for (int i = 0; i < n.entryCount; i++) {
+                const Rectangle current = entryAt(e, i);
+                const Rectangle enlarged = unite(current, entry);
+
+                // Children are leaves: minimise the overlap with the siblings first.
+                Distance overlapIncrease = 0;
+                if (n.level == 2) {
+                    for (int j = 0; j < n.entryCount; j++) {
+                        if (j == i) continue;
+                        const Rectangle sibling = entryAt(e, j);
+                        overlapIncrease += overlap(enlarged, sibling) - overlap(current, sibling);
+                    }
+                }
+                const Distance enlargement = area(enlarged) - area(current);
+                const Distance currentArea = area(current);
+
+                if (std::tie(overlapIncrease, enlargement, currentArea) < std::tie(bestOverlap, bestEnlargement, bestArea)) {
+                    best = i;
+                    bestOverlap = overlapIncrease;
+                    bestEnlargement = enlargement;
+                    bestArea = currentArea;
+                }
+            }
+
+            nodeId = e.ids[best];
+            path.push_back(nodeId);
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::addToPath(std::vector<int>& path, const Rectangle& entry, std::vector<bool>& reinserted) {
+        const int nodeId = path.back();
+        const int level = m_nodes.node(nodeId).level;
+
+        std::vector<Rectangle> entries;
+        m_nodes.readEntries(nodeId, entries);
+        entries.push_back(entry);
+
+        if (static_cast<int>(entries.size()) <= m_capacity) {
+            m_nodes.writeEntries(nodeId, entries.data(), static_cast<int>(entries.size()));
+            adjustPath(path);
+            return;
+        }
+
+        if (static_cast<int>(reinserted.size()) <= level) {
+            reinserted.resize(level + 1, false);
+        }
+
+        // First overflow of this level: reinsert the entries farthest from the node's centre.
+        if (nodeId != m_rootNodeId && !reinserted[level]) {
+            reinserted[level] = true;
+
+            Rectangle bounds = entries.front();
+            for (const auto& e : entries) bounds = unite(bounds, e);
+            std::array<Distance, D> nodeCenter;
+            for (int d = 0; d < D; d++) {
+                nodeCenter[d] = center<Distance>(bounds, d);
+            }
+            auto distance = [&nodeCenter](const Rectangle& e) {
+                Distance total = 0;
+                for (int d = 0; d < D; d++) {
+                    const Distance delta = center<Distance>(e, d) - nodeCenter[d];
+                    total += delta * delta;
+                }
+                return total;
+            };
+            std::sort(entries.begin(), entries.end(), [&distance](const Rectangle& a, const Rectangle& b) {
+                return distance(a) > distance(b);
+            });
+
+            const int count = std::max(1, static_cast<int>(m_capacity * REINSERT_RATIO));
+            const std::vector<Rectangle> removed(entries.begin(), entries.begin() + count);
+            m_nodes.writeEntries(nodeId, entries.data() + count, static_cast<int>(entries.size()) - count);
+            adjustPath(path);
+
+            // Close reinsert: the nearest of the removed entries goes first.
+            for (auto it = removed.rbegin(); it != removed.rend(); ++it) {
+                insertEntry(*it, level, reinserted);
+            }
+            return;
+        }
+
+        const int siblingId = splitNode(nodeId, entries);
+
+        if (nodeId == m_rootNodeId) {
+            // The root split: grow the tree by one level.
+            const int rootId = m_nodes.createNode(level + 1);
+            const Rectangle children[2] = {entryOf(m_nodes, nodeId), entryOf(m_nodes, siblingId)};
+            m_nodes.writeEntries(rootId, children, 2);
+            m_rootNodeId = rootId;
+            treeHeight = level + 1;
+            return;
+        }
+
+        path.pop_back();
+        updateChildEntry(path.back(), nodeId);
+        addToPath(path, entryOf(m_nodes, siblingId), reinserted);
+    }
+
+    template<int D, typename T, int Capacity>
+    int BasicRTree<D, T, Capacity>::splitNode(int nodeId, std::vector<Rectangle>& entries) {
+        const int total = static_cast<int>(entries.size());
+        const int minFill = std::min(minEntries(), total / 2);
+
+        // Every axis is tried sorted by the lower and by the upper bounds of the entries.
+        auto sortOn = [](std::vector<Rectangle>& sorted, int axis, bool byMax) {
+            std::sort(sorted.begin(), sorted.end(), [axis, byMax](const Rectangle& a, const Rectangle& b) {
+                return byMax ? std::tie(a.max[axis], a.min[axis]) < std::tie(b.max[axis], b.min[axis])
+                             : std::tie(a.min[axis], a.max[axis]) < std::tie(b.min[axis], b.max[axis]);
+            });
+        };
+
+        // Bounds of every prefix and suffix of a sorted order, so each distribution is O(1).
+        std::vector<Rectangle> prefix(total);
+        std::vector<Rectangle> suffix(total);
+        auto computeBounds = [&](const std::vector<Rectangle>& sorted) {
+            prefix[0] = sorted[0];
+            for (int i = 1; i < total; i++) prefix[i] = unite(prefix[i - 1], sorted[i]);
+            suffix[total - 1] = sorted[total - 1];
+            for (int i = total - 2; i >= 0; i--) suffix[i] = unite(suffix[i + 1], sorted[i]);
+        };
+
+        // Choose the split axis: the one with the smallest sum of margins over all distributions.
+        int axis = 0;
+        Distance bestMargin = std::numeric_limits<Distance>::max();
+        std::vector<Rectangle> sorted = entries;
+        for (int a = 0; a < D; a++) {
+            Distance marginSum = 0;
+            for (bool byMax : {false, true}) {
+                sortOn(sorted, a, byMax);
+                computeBounds(sorted);
+                for (int k = minFill; k <= total - minFill; k++) {
+                    marginSum += margin(prefix[k - 1]) + margin(suffix[k]);
+                }
+            }
+            if (marginSum < bestMargin) {
+                bestMargin = marginSum;
+                axis = a;
+            }
+        }
+
+        // Along that axis, choose the distribution with the least overlap, then the least area.
+        Distance bestOverlap = std::numeric_limits<Distance>::max();
+        Distance bestArea = std::numeric_limits<Distance>::max();
+        int bestSplit = minFill;
+        for (bool byMax : {false, true}) {
+            sortOn(sorted, axis, byMax);
+            computeBounds(sorted);
+            for (int k = minFill; k <= total - minFill; k++) {
+                const Distance o = overlap(prefix[k - 1], suffix[k]);
+                const Distance a = area(prefix[k - 1]) + area(suffix[k]);
+                if (std::tie(o, a) < std::tie(bestOverlap, bestArea)) {
+                    bestOverlap = o;
+                    bestArea = a;
+                    bestSplit = k;
+                    entries = sorted;
+                }
+            }
+        }
+
+        const int siblingId = m_nodes.createNode(m_nodes.node(nodeId).level);
+        m_nodes.writeEntries(nodeId, entries.data(), bestSplit);
+        m_nodes.writeEntries(siblingId, entries.data() + bestSplit, total - bestSplit);
+        return siblingId;
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::adjustPath(const std::vector<int>& path) {
+        bool resized = true;
+        for (std::size_t i = path.size() - 1; i > 0; i--) {
+            // An unchanged entry leaves the MBR of every ancestor unchanged as well, but not its count.
+            if (resized) resized = updateChildEntry(path[i - 1], path[i]);
+            m_nodes.recountSubtree(path[i - 1]);
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    bool BasicRTree<D, T, Capacity>::updateChildEntry(int parentId, int childId) {
+        const Rectangle child = entryOf(m_nodes, childId);
+        const NodeEntries e = m_nodes.entries(parentId);
+        const int count = m_nodes.node(parentId).entryCount;
+
+        int slot = 0;
+        while (slot < count && e.ids[slot] != childId) slot++;
+        if (entryAt(e, slot).equals(child)) {
+            return false;
+        }
+
+        std::vector<Rectangle> entries;
+        m_nodes.readEntries(parentId, entries);
+        entries[slot] = child;
+        m_nodes.writeEntries(parentId, entries.data(), count);
+        return true;
+    }
+
+    template<int D, typename T, int Capacity>
+    int BasicRTree<D, T, Capacity>::findLeaf(int id, const Rectangle& mbr, std::vector<int>& path) const {
+        // Depth-first search through the children whose MBR contains the rectangle.
+        std::vector<std::pair<int, int>> stack{{m_rootNodeId, 0}};
+        while (!stack.empty()) {
+            auto [nodeId, depth] = stack.back();
+            stack.pop_back();
+            path.resize(depth);
+            path.push_back(nodeId);
+
+            const Node& n = m_nodes.node(nodeId);
+            const NodeEntries e = m_nodes.entries(nodeId);
+            for (int i = 0; i < n.entryCount && e.min[0][i] <= mbr.min[0]; i++) {
+                const Rectangle entry = entryAt(e, i);
+                if (n.isLeaf()) {
+                    if (entry.id == id && entry.equals(mbr)) {
+                        return i;
+                    }
+                } else if (entry.contains(mbr)) {
+                    stack.emplace_back(entry.id, depth + 1);
+                }
+            }
+        }
+        return -1;
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::condenseTree(const std::vector<int>& path) {
+        // Entries of dissolved nodes, with the level of the node they have to go back into.
+        std::vector<std::pair<int, Rectangle>> orphans;
+        std::vector<Rectangle> entries;
+
+        bool resized = true;
+        for (std::size_t i = path.size() - 1; i > 0; i--) {
+            const int nodeId = path[i];
+            const int parentId = path[i - 1];
+
+            if (m_nodes.node(nodeId).entryCount < minEntries()) {
+                const NodeEntries e = m_nodes.entries(parentId);
+                int slot = 0;
+                while (e.ids[slot] != nodeId) slot++;
+                m_nodes.deleteEntry(parentId, slot);
+
+                const int level = m_nodes.node(nodeId).level;
+                m_nodes.readEntries(nodeId, entries);
+                for (const auto& entry : entries) orphans.emplace_back(level, entry);
+                m_nodes.releaseNode(nodeId);
+            } else {
+                if (resized) resized = updateChildEntry(parentId, nodeId);
+                m_nodes.recountSubtree(parentId);
+            }
+        }
+
+        // Every child of the root was dissolved: start over from an empty leaf.
+        if (!m_nodes.node(m_rootNodeId).isLeaf() && m_nodes.node(m_rootNodeId).entryCount == 0) {
+            m_nodes.initNode(m_rootNodeId, 1);
+            treeHeight = 1;
+        }
+
+        // Reinsert the orphans, higher levels first so the lower ones find their subtrees.
+        std::stable_sort(orphans.begin(), orphans.end(), [](const auto& a, const auto& b) {
+            return a.first > b.first;
+        });
+        for (const auto& [level, entry] : orphans) {
+            std::vector<bool> reinserted(treeHeight + 1, false);
+            if (level <= treeHeight) {
+                insertEntry(entry, level, reinserted);
+            } else {
+                // The tree has become too low for the subtree: reinsert its rectangles one by one.
+                entries.clear();
+                dissolveSubtree(entry.id, entries);
+                for (const auto& leafEntry : entries) {
+                    std::fill(reinserted.begin(), reinserted.end(), false);
+                    insertEntry(leafEntry, 1, reinserted);
+                }
+            }
+        }
+
+        // Shorten the tree while the root has a single child.
+        while (!m_nodes.node(m_rootNodeId).isLeaf() && m_nodes.node(m_rootNodeId).entryCount == 1) {
+            const int childId = m_nodes.entries(m_rootNodeId).ids[0];
+            m_nodes.releaseNode(m_rootNodeId);
+            m_rootNodeId = childId;
+            treeHeight--;
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::dissolveSubtree(int nodeId, std::vector<Rectangle>& entries) {
+        const Node& n = m_nodes.node(nodeId);
+        const NodeEntries e = m_nodes.entries(nodeId);
+        for (int i = 0; i < n.entryCount; i++) {
+            if (n.isLeaf()) {
+                entries.push_back(entryAt(e, i));
+            } else {
+                dissolveSubtree(e.ids[i], entries);
+            }
+        }
+        m_nodes.releaseNode(nodeId);
+    }
+
+    template<int D, typename T, int Capacity>
+    int BasicRTree<D, T, Capacity>::getLeafsSize() const {
         return m_totalRectangles;
     }
 
     // Queries
 
-    void RTreeBulkLoad::getLeafs(Node* node, std::vector<int>& leafs) {
-        
-        if (node->isLeaf()) {
-            leafs.insert(leafs.end(), node->ids.begin(), node->ids.end());
+    namespace {
+
+        /**
+         * A coordinate moved down or up by a distance. Integer coordinates are rounded outwards
+         * and clamped to their range, so that a box grown by a distance still contains every
+         * point within that distance.
+         */
+        template<typename T, typename Distance>
+        T lowered(T value, Distance amount) {
+            if constexpr (std::is_floating_point_v<T>) {
+                return value - amount;
+            } else {
+                return static_cast<T>(std::max<Distance>(std::floor(value - amount), std::numeric_limits<T>::lowest()));
+            }
+        }
+
+        template<typename T, typename Distance>
+        T raised(T value, Distance amount) {
+            if constexpr (std::is_floating_point_v<T>) {
+                return value + amount;
+            } else {
+                return static_cast<T>(std::min<Distance>(std::ceil(value + amount), std::numeric_limits<T>::max()));
+            }
+        }
+
+        /**
+         * The entries of a leaf restricted to a window, copied into contiguous arrays sorted by
+         * the minimum on the first axis and followed by SIMD_WIDTH empty rectangles, as the join
+         * kernels expect. The copies can be grown by a distance; slots maps them back to the
+         * entries of the leaf.
+         */
+        template<int D, typename T>
+        struct EntryRun {
+            std::vector<int> slots;
+            std::array<std::vector<T>, D> min;
+            std::array<std::vector<T>, D> max;
+            std::vector<int> ids;
+            int count = 0;
+
+            void assign(const BasicNodeEntries<D, T>& entries, int entryCount, const T* windowMin, const T* windowMax,
+                        DistanceType<T> grow = 0) {
+                slots.resize(entryCount + 2 * SIMD_WIDTH);
+                count = static_cast<int>(NodeKernels<D, T>::filterRange(entries, entryCount, windowMin, windowMax,
+                                                                        slots.data()));
+                const std::size_t size = count + SIMD_WIDTH;
+                for (int d = 0; d < D; d++) {
+                    min[d].resize(size);
+                    max[d].resize(size);
+                }
+                ids.resize(size);
+                for (int i = 0; i < count; i++) {
+                    const int slot = slots[i];
+                    for (int d = 0; d < D; d++) {
+                        min[d][i] = lowered(entries.min[d][slot], grow);
+                        max[d][i] = raised(entries.max[d][slot], grow);
+                    }
+                    ids[i] = entries.ids[slot];
+                }
+                for (int d = 0; d < D; d++) {
+                    std::fill(min[d].begin() + count, min[d].end(), std::numeric_limits<T>::max());
+                    std::fill(max[d].begin() + count, max[d].end(), std::numeric_limits<T>::lowest());
+                }
+                std::fill(ids.begin() + count, ids.end(), -1);
+            }
+
+            /**
+             * @return The copies as node entries, labelled with the given ids.
+             */
+            BasicNodeEntries<D, T> entries(int* labels) {
+                BasicNodeEntries<D, T> e;
+                for (int d = 0; d < D; d++) {
+                    e.min[d] = min[d].data();
+                    e.max[d] = max[d].data();
+                }
+                e.ids = labels;
+                return e;
+            }
+        };
+
+        /**
+         * Per-thread traversal state reused across queries, so that steady-state queries
+         * perform no heap allocation.
+         */
+        template<int D, typename T>
+        struct QueryScratch {
+            using Distance = DistanceType<T>;
+
+            std::vector<int> nodeStack;
+            std::vector<int> childSlots;
+            std::vector<int> leafResults;
+            std::vector<std::pair<Distance, int>> nodeQueue;
+            std::vector<std::pair<Distance, int>> distanceQueue;
+            std::vector<Distance> candidateDistances;
+            std::vector<int> candidateSlots;
+            std::vector<std::pair<Distance, int>> neighborHeaps;
+            std::vector<int> heapSizes;
+            std::vector<Distance> queryBounds;
+            std::vector<Distance> queryPoints;
+            std::vector<std::pair<int, int>> nodePairs;
+            std::vector<int> pairsA;
+            std::vector<int> pairsB;
+            EntryRun<D, T> runA;
+            EntryRun<D, T> runB;
+            QueryStats stats;
+        };
+
+        /**
+         * @return The scratch of the calling thread for trees of the given dimensions and coordinate type.
+         */
+        template<int D, typename T>
+        QueryScratch<D, T>& queryScratch() {
+            thread_local QueryScratch<D, T> scratch;
+            return scratch;
+        }
+
+        /**
+         * Number of queries a worker claims at a time in the batch APIs.
+         */
+        constexpr std::size_t BATCH_GRAIN = 64;
+
+        /**
+         * Number of node pairs per worker the parallel join expands the top of the trees into
+         * before handing them to the work-stealing scheduler.
+         */
+        constexpr std::size_t JOIN_TASKS_PER_WORKER = 16;
+
+        /**
+         * Number of pairs a worker buffers before handing them to a shared join sink.
+         */
+        constexpr std::size_t JOIN_FLUSH_PAIRS = 1 << 14;
+
+#ifdef RTREE_STATS
+        /**
+         * Adds the traversal counters collected by the other workers of a pool to those of the
+         * calling thread, which is worker 0.
+         */
+        template<int D, typename T>
+        void gatherStats(ThreadPool& pool) {
+            std::vector<QueryStats> workerStats(pool.size());
+            pool.run([&workerStats](int worker) {
+                if (worker == 0) return;
+                QueryStats& stats = queryScratch<D, T>().stats;
+                workerStats[worker] = stats;
+                stats = QueryStats();
+            });
+            for (const QueryStats& stats : workerStats) queryScratch<D, T>().stats += stats;
+        }
+#endif
+
+        /**
+         * Runs one query per element of queries on the pool and merges the per-worker
+         * result buffers into results, in query order.
+         *
+         * @param runQuery Callable invoked as runQuery(query, buffer), appending to buffer
+         *                 and returning the number of values appended.
+         */
+        template<int D, typename T, typename Value, typename Query, typename RunQuery>
+        void runBatch(const std::vector<Query>& queries, BatchResults<Value>& results, ThreadPool& pool,
+                      RunQuery&& runQuery) {
+            struct Chunk {
+                std::size_t begin;
+                std::size_t end;
+                std::size_t offset;
+            };
+            const std::size_t count = queries.size();
+            std::vector<std::vector<Value>> buffers(pool.size());
+            std::vector<std::vector<Chunk>> chunks(pool.size());
+
+            // offsets[q + 1] temporarily holds the result count of query q.
+            results.offsets.assign(count + 1, 0);
+            pool.parallelFor(count, BATCH_GRAIN, [&](std::size_t begin, std::size_t end, int worker) {
+                std::vector<Value>& buffer = buffers[worker];
+                chunks[worker].push_back({begin, end, buffer.size()});
+                for (std::size_t q = begin; q < end; q++) {
+                    results.offsets[q + 1] = runQuery(queries[q], buffer);
+                }
+            });
+
+            for (std::size_t q = 0; q < count; q++) {
+                results.offsets[q + 1] += results.offsets[q];
+            }
+
+            results.values.resize(results.offsets[count]);
+            pool.run([&](int worker) {
+                for (const Chunk& chunk : chunks[worker]) {
+                    const auto first = buffers[worker].begin() + chunk.offset;
+                    const std::size_t length = results.offsets[chunk.end] - results.offsets[chunk.begin];
+                    std::copy(first, first + length, results.values.begin() + results.offsets[chunk.begin]);
+                }
+            });
+            RTREE_STAT(gatherStats<D, T>(pool));
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    template<typename LeafVisitor>
+    void BasicRTree<D, T, Capacity>::forEachLeaf(int nodeId, LeafVisitor&& visit) const {
+        const Node& node = m_nodes.node(nodeId);
+
+        if (node.isLeaf()) {
+            visit(node);
         }
         else {
-            for (auto child : node->children) {
-                getLeafs(child, leafs);
+            const NodeEntries e = m_nodes.entries(nodeId);
+            for (int i = 0; i < node.entryCount; i++) {
+                forEachLeaf(e.ids[i], visit);
             }
         }
     }
 
-    void RTreeBulkLoad::range(const Rectangle& r) {
-        std::vector<int> m_ids;
-        std::stack<Node*> nodeStack;
+    template<int D, typename T, int Capacity>
+    template<typename LeafVisitor>
+    void BasicRTree<D, T, Capacity>::rangeTraverse(const Rectangle& r, LeafVisitor&& visit) const {
+        QueryScratch<D, T>& scratch = queryScratch<D, T>();
+        std::vector<int>& nodeStack = scratch.nodeStack;
+        std::vector<int>& childSlots = scratch.childSlots;
+        nodeStack.clear();
+        childSlots.resize(m_nodes.stride());
 
-        const float minX = r.minX;
-        const float minY = r.minY;
-        const float maxX = r.maxX;
-        const float maxY = r.maxY;
+        const T* min = r.min.data();
+        const T* max = r.max.data();
 
-        nodeStack.push(m_root);
+        nodeStack.push_back(m_rootNodeId);
 
         while (!nodeStack.empty()) {
-            const auto n = nodeStack.top();
-            nodeStack.pop();
+            const Node& n = m_nodes.node(nodeStack.back());
+            nodeStack.pop_back();
+            RTREE_STAT(scratch.stats.visit(n.level));
 
-            if (!intersects(minX, minY, maxX, maxY,
-                n->mbrMinX, n->mbrMinY, n->mbrMaxX, n->mbrMaxY))
+            if (!Rectangle::intersects(min, max, n.mbrMin.data(), n.mbrMax.data()))
                 continue;
 
-            if (!n->isLeaf()) {
-                if (Rectangle::contains(minX, minY, maxX, maxY,
-                    n->mbrMinX, n->mbrMinY, n->mbrMaxX, n->mbrMaxY))
+            if (!n.isLeaf()) {
+                if (Rectangle::contains(min, max, n.mbrMin.data(), n.mbrMax.data()))
                 {
-                    getLeafs(n, m_ids);
+                    RTREE_STAT(scratch.stats.containedSubtrees++);
+                    visit(n, true);
                     continue;
                 }
 
-                for (auto child : n->children) {
+                // Filter the inlined child MBRs; only the surviving children are dereferenced.
+                const NodeEntries e = m_nodes.entries(n.nodeId);
+                const uint32_t hits = Kernels::filterRange(e, n.entryCount, min, max, childSlots.data());
+                RTREE_STAT(scratch.stats.entriesTested += n.entryCount; scratch.stats.entriesPruned += n.entryCount - hits);
+                for (uint32_t i = 0; i < hits; i++) {
+                    nodeStack.push_back(e.ids[childSlots[i]]);
+                }
+                continue;
+            }
 
-                    if(child->mbrMaxX < minX)
-                        continue;
+            visit(n, false);
+        }
+    }
 
-                    if (child->mbrMinX > maxX) {
-                        break;
-                    }
+    template<int D, typename T, int Capacity>
+    uint32_t BasicRTree<D, T, Capacity>::sweepLeafs(const Rectangle& rangeQ, const Node& leaf, int* out) const {
+        const NodeEntries e = m_nodes.entries(leaf.nodeId);
+        const uint32_t hits = Kernels::sweepRange(e, leaf.entryCount, rangeQ.min.data(), rangeQ.max.data(), out);
+        RTREE_STAT(QueryStats& stats = queryScratch<D, T>().stats;
+                   stats.entriesTested += leaf.entryCount; stats.entriesPruned += leaf.entryCount - hits;
+                   stats.results += hits);
+        return hits;
+    }
 
-                    if (intersects(minX, minY, maxX, maxY,
-                        child->mbrMinX, child->mbrMinY, child->mbrMaxX, child->mbrMaxY))
-                    {
-                        nodeStack.push(child);
-                    }
-                }
-                continue;
+    template<int D, typename T, int Capacity>
+    uint32_t BasicRTree<D, T, Capacity>::range(const Rectangle& r, std::vector<int>& results) const {
+        const std::size_t start = results.size();
+        RTREE_STAT(QueryStats& stats = queryScratch<D, T>().stats; stats.queries++);
+
+        rangeTraverse(r, [&](const Node& node, bool contained) {
+            if (contained) {
+                RTREE_STAT(stats.results += node.subtreeCount);
+                forEachLeaf(node.nodeId, [&](const Node& leaf) {
+                    const int* ids = m_nodes.entries(leaf.nodeId).ids;
+                    results.insert(results.end(), ids, ids + leaf.entryCount);
+                });
+                return;
             }
+            uint32_t size = results.size();
+            // The padded arrays leave room for the vector stores of the sweep.
+            results.resize(size + m_nodes.stride());
+            size += sweepLeafs(r, node, results.data() + size);
+            results.resize(size);
+        });
+        return results.size() - start;
+    }
 
-            uint32_t size = m_ids.size();
-            m_ids.resize(size+m_capacity);
+    template<int D, typename T, int Capacity>
+    uint32_t BasicRTree<D, T, Capacity>::range(const Rectangle& r, ResultSink& sink) const {
+        QueryScratch<D, T>& scratch = queryScratch<D, T>();
+        std::vector<int>& leafResults = scratch.leafResults;
+        leafResults.resize(m_nodes.stride());
+        uint32_t total = 0;
+        RTREE_STAT(scratch.stats.queries++);
 
-            int currentLeaf = 0, currentRange = 0;
-            uint32_t totalLeafs = n->leafs.size();
+        rangeTraverse(r, [&](const Node& node, bool contained) {
+            if (contained) {
+                RTREE_STAT(scratch.stats.results += node.subtreeCount);
+                // Contained leaves are handed out straight from the node store.
+                forEachLeaf(node.nodeId, [&](const Node& leaf) {
+                    sink.accept(m_nodes.entries(leaf.nodeId).ids, leaf.entryCount);
+                });
+                total += node.subtreeCount;
+                return;
+            }
+            const uint32_t hits = sweepLeafs(r, node, leafResults.data());
+            if (hits > 0) {
+                sink.accept(leafResults.data(), hits);
+                total += hits;
+            }
+        });
+        return total;
+    }
 
-            while(currentLeaf < totalLeafs && currentRange < 1){
-                if (minX < n->leafs[currentLeaf].minX){
-                    sweepLeafsNext(r, n->leafs, currentLeaf, totalLeafs, m_ids, size);
-                    currentRange++;
-                }else{
-                    sweepLeafs(n->leafs[currentLeaf], r, currentRange, 1, m_ids, size);
-                    currentLeaf++;
-                }
+    template<int D, typename T, int Capacity>
+    uint64_t BasicRTree<D, T, Capacity>::rangeCount(const Rectangle& r) const {
+        uint64_t total = 0;
+        RTREE_STAT(QueryStats& stats = queryScratch<D, T>().stats; stats.queries++);
+
+        rangeTraverse(r, [&](const Node& node, bool contained) {
+            if (contained) {
+                total += node.subtreeCount;
+                return;
             }
+            const NodeEntries e = m_nodes.entries(node.nodeId);
+            const uint32_t hits = Kernels::countRange(e, node.entryCount, r.min.data(), r.max.data());
+            RTREE_STAT(stats.entriesTested += node.entryCount; stats.entriesPruned += node.entryCount - hits);
+            total += hits;
+        });
+        RTREE_STAT(stats.results += total);
+        return total;
+    }
 
-           m_ids.resize(size);
-        }
-        //std::cout << m_ids.size() << std::endl;
-        // Write results to a file
-        /*std::ofstream outFile("/home/serafm/dev/rtree_cpp/range_results.txt", std::ios::app);
-        if (!outFile) {
-            std::cerr << "Error: Unable to open file for writing results!" << std::endl;
-            return;
+    namespace {
+
+        /**
+         * Fraction of the extent [minimum, maximum] covered by [rangeMin, rangeMax], which must
+         * intersect it. A degenerate extent is covered entirely.
+         */
+        template<typename T>
+        inline double coveredFraction(T minimum, T maximum, T rangeMin, T rangeMax) {
+            const double extent = static_cast<double>(maximum) - minimum;
+            if (extent <= 0) return 1.0;
+            return (static_cast<double>(std::min(maximum, rangeMax)) - std::max(minimum, rangeMin)) / extent;
         }
-        outFile << m_ids.size() << "\n";*/
     }
 
-    void RTreeBulkLoad::sweepLeafs(Rectangle& leaf, const Rectangle& rangeQ, int start, int size, std::vector<int>& results, uint32_t& res_size){
-        int counter = start;
-        
-        while(counter < size && leaf.maxX >= rangeQ.minX){
-            if (leaf.minY > rangeQ.maxY || leaf.maxY < rangeQ.minY){
-                counter++;
+    template<int D, typename T, int Capacity>
+    CountEstimate BasicRTree<D, T, Capacity>::rangeCountEstimate(const Rectangle& r, int level) const {
+        CountEstimate result{0, 0, 0.0};
+        QueryScratch<D, T>& scratch = queryScratch<D, T>();
+        RTREE_STAT(scratch.stats.queries++);
+        std::vector<int>& nodeStack = scratch.nodeStack;
+        std::vector<int>& childSlots = scratch.childSlots;
+        nodeStack.clear();
+        childSlots.resize(m_nodes.stride());
+
+        const T* min = r.min.data();
+        const T* max = r.max.data();
+
+        nodeStack.push_back(m_rootNodeId);
+
+        while (!nodeStack.empty()) {
+            const Node& n = m_nodes.node(nodeStack.back());
+            nodeStack.pop_back();
+            RTREE_STAT(scratch.stats.visit(n.level));
+
+            if (!Rectangle::intersects(min, max, n.mbrMin.data(), n.mbrMax.data()))
+                continue;
+
+            if (Rectangle::contains(min, max, n.mbrMin.data(), n.mbrMax.data())) {
+                RTREE_STAT(scratch.stats.containedSubtrees++);
+                result.lower += n.subtreeCount;
+                result.upper += n.subtreeCount;
+                result.estimate += n.subtreeCount;
+                continue;
+            }
+
+            if (n.level <= level) {
+                result.upper += n.subtreeCount;
+                double estimate = n.subtreeCount;
+                for (int d = 0; d < D; d++) {
+                    estimate *= coveredFraction(n.mbrMin[d], n.mbrMax[d], min[d], max[d]);
+                }
+                result.estimate += estimate;
                 continue;
             }
-            results[res_size++] = leaf.id;
-            counter++;
-        }
-    }
 
-    void RTreeBulkLoad::sweepLeafsNext(const Rectangle& rangeQ, std::vector<Rectangle>& leafs, int start, int size, std::vector<int>& results, uint32_t& res_size){
-        int counter = start;
-        
-        while (counter < size && rangeQ.maxX >= leafs[counter].minX){
-            if (rangeQ.minY > leafs[counter].maxY || rangeQ.maxY < leafs[counter].minY) {
-                counter++;
+            const NodeEntries e = m_nodes.entries(n.nodeId);
+            if (n.isLeaf()) {
+                const uint32_t hits = Kernels::countRange(e, n.entryCount, min, max);
+                RTREE_STAT(scratch.stats.entriesTested += n.entryCount; scratch.stats.entriesPruned += n.entryCount - hits);
+                result.lower += hits;
+                result.upper += hits;
+                result.estimate += hits;
                 continue;
             }
-            results[res_size++] = leafs[counter].id;
-            counter++;
+
+            const uint32_t hits = Kernels::filterRange(e, n.entryCount, min, max, childSlots.data());
+            RTREE_STAT(scratch.stats.entriesTested += n.entryCount; scratch.stats.entriesPruned += n.entryCount - hits);
+            for (uint32_t i = 0; i < hits; i++) {
+                nodeStack.push_back(e.ids[childSlots[i]]);
+            }
         }
+        RTREE_STAT(scratch.stats.results += result.lower);
+        return result;
     }
 
-    void RTreeBulkLoad::nearestN(const Point &p, int k) {
-        std::priority_queue<std::pair<float, int>> m_distanceQueue;
-        const float qx = p.x;
-        const float qy = p.y;
+    template<int D, typename T, int Capacity>
+    int BasicRTree<D, T, Capacity>::nearestN(const Point &p, int k, std::vector<Neighbor>& results) const {
+        if (k <= 0) return 0;
+        QueryScratch<D, T>& scratch = queryScratch<D, T>();
+        RTREE_STAT(scratch.stats.queries++);
+
+        // A max-heap of the best k candidates found so far.
+        std::vector<std::pair<Distance, int>>& m_distanceQueue = scratch.distanceQueue;
+        m_distanceQueue.clear();
+        std::array<Distance, D> point;
+        for (int d = 0; d < D; d++) {
+            point[d] = p[d];
+        }
 
-        float furthestNeighborDistance = MAXFLOAT;
+        // Infinite until k candidates are found, so that every entry is kept until then.
+        Distance furthestNeighborDistance = std::numeric_limits<Distance>::infinity();
 
         // A min-heap for nodes based on their bounding box distance to the query point.
-        using NodePair = std::pair<float, Node*>;
-        std::priority_queue<
-            NodePair,
-            std::vector<NodePair>,
-            std::greater<NodePair>
-        > nodeQueue;
+        using NodePair = std::pair<Distance, int>;
+        std::vector<NodePair>& nodeQueue = scratch.nodeQueue;
+        nodeQueue.clear();
+        const auto nodeOrder = std::greater<NodePair>();
 
-        nodeQueue.emplace(MAXFLOAT, m_root);
+        // The entries of a node nearer than the current bound, as computed by filterDistance.
+        std::vector<Distance>& candidateDistances = scratch.candidateDistances;
+        std::vector<int>& candidateSlots = scratch.candidateSlots;
+        candidateDistances.resize(m_nodes.stride());
+        candidateSlots.resize(m_nodes.stride());
+
+        nodeQueue.emplace_back(0, m_rootNodeId);
 
         // Best-first search.
         while (!nodeQueue.empty()) {
-            const auto [dist, n] = nodeQueue.top();
-            nodeQueue.pop();
+            std::pop_heap(nodeQueue.begin(), nodeQueue.end(), nodeOrder);
+            const auto [dist, nodeId] = nodeQueue.back();
+            nodeQueue.pop_back();
+            RTREE_STAT(scratch.stats.heapOperations++);
 
             // Exit if no more nodes smaller than the maximum already in queue
-            if (m_distanceQueue.size() == k && dist >= furthestNeighborDistance) {
+            if (dist >= furthestNeighborDistance) {
+                RTREE_STAT(scratch.stats.entriesPruned += nodeQueue.size() + 1);
                 break;
             }
 
-            if (!n->isLeaf()) {
-                // For internal nodes, push children into the nodeQueue.
-                for (const auto child : n->children) {
-                    float childDist = Rectangle::distance(
-                        child->mbrMinX, child->mbrMinY,
-                        child->mbrMaxX, child->mbrMaxY,
-                        qx, qy
-                    );
-                    nodeQueue.emplace(childDist, child);
+            const Node& n = m_nodes.node(nodeId);
+            const NodeEntries e = m_nodes.entries(nodeId);
+            RTREE_STAT(scratch.stats.visit(n.level));
+
+            // Children and entries no nearer than the current k-th neighbour can be skipped.
+            const uint32_t candidates = Kernels::filterDistance(e, n.entryCount, point.data(), furthestNeighborDistance,
+                                                                candidateDistances.data(), candidateSlots.data());
+            RTREE_STAT(scratch.stats.entriesTested += n.entryCount; scratch.stats.entriesPruned += n.entryCount - candidates);
+
+            if (!n.isLeaf()) {
+                // For internal nodes, push the surviving children into the nodeQueue.
+                for (uint32_t i = 0; i < candidates; i++) {
+                    nodeQueue.emplace_back(candidateDistances[i], e.ids[candidateSlots[i]]);
+                    std::push_heap(nodeQueue.begin(), nodeQueue.end(), nodeOrder);
                 }
+                RTREE_STAT(scratch.stats.heapOperations += candidates);
                 continue;
             }
-            // For leaf nodes, process each entry.
-            for (const auto leaf : n->leafs) {
-                const float entryDistance = Rectangle::distance(
-                    leaf.minX, leaf.minY, leaf.maxX, leaf.maxY,
-                    qx, qy
-                );
-
-                uint32_t queue_size = m_distanceQueue.size();
-                if (queue_size < k) {
-                    m_distanceQueue.emplace(entryDistance, leaf.id);
-                    if (queue_size == k) {
-                        furthestNeighborDistance = m_distanceQueue.top().first;
+            // For leaf nodes, process each surviving entry; the bound tightens as the heap fills.
+            for (uint32_t i = 0; i < candidates; i++) {
+                const Distance entryDistance = candidateDistances[i];
+                const int id = e.ids[candidateSlots[i]];
+
+                if (m_distanceQueue.size() < k) {
+                    m_distanceQueue.emplace_back(entryDistance, id);
+                    std::push_heap(m_distanceQueue.begin(), m_distanceQueue.end());
+                    RTREE_STAT(scratch.stats.heapOperations++);
+                } else if (entryDistance < furthestNeighborDistance) {
+                    std::pop_heap(m_distanceQueue.begin(), m_distanceQueue.end());
+                    m_distanceQueue.back() = {entryDistance, id};
+                    std::push_heap(m_distanceQueue.begin(), m_distanceQueue.end());
+                    RTREE_STAT(scratch.stats.heapOperations += 2);
+                } else {
+                    RTREE_STAT(scratch.stats.entriesPruned++);
+                    continue;
+                }
+                if (m_distanceQueue.size() == k) {
+                    furthestNeighborDistance = m_distanceQueue.front().first;
+                }
+            }
+        }
+
+        // Drain the candidates in ascending distance order.
+        std::sort_heap(m_distanceQueue.begin(), m_distanceQueue.end());
+        for (const auto& [distance, id] : m_distanceQueue) {
+            results.push_back({id, distance});
+        }
+        RTREE_STAT(scratch.stats.results += m_distanceQueue.size());
+        return static_cast<int>(m_distanceQueue.size());
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::rangeBatch(const std::vector<Rectangle>& queries, BatchResults<int>& results,
+                                      ThreadPool& pool) const {
+        runBatch<D, T>(queries, results, pool, [this](const Rectangle& query, std::vector<int>& buffer) {
+            return range(query, buffer);
+        });
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicRTree<D, T, Capacity>::nearestBatch(const std::vector<Point>& queries, int k, BatchResults<Neighbor>& results,
+                                        ThreadPool& pool) const {
+        runBatch<D, T>(queries, results, pool, [this, k](const Point& query, std::vector<Neighbor>& buffer) {
+            return nearestN(query, k, buffer);
+        });
+    }
+
+    template<int D, typename T, int Capacity>
+    template<typename PushPair, typename PairVisitor>
+    void BasicRTree<D, T, Capacity>::joinPair(const BasicRTree& rtreeB, Distance epsilon, int idA, int idB, int* pairsA, int* pairsB,
+                                    PushPair&& push, PairVisitor&& visit) const {
+        const Node& nodeA = m_nodes.node(idA);
+        const Node& nodeB = rtreeB.m_nodes.node(idB);
+        const NodeEntries a = m_nodes.entries(idA);
+        const NodeEntries b = rtreeB.m_nodes.entries(idB);
+        RTREE_STAT(QueryStats& stats = queryScratch<D, T>().stats; stats.nodePairs++; stats.visit(nodeA.level));
+
+        // Prune if the two MBRs are further apart than epsilon.
+        if (!withinDistance(nodeA.mbrMin.data(), nodeA.mbrMax.data(), nodeB.mbrMin.data(), nodeB.mbrMax.data(), epsilon))
+        {
+            return;
+        }
+
+        // Case 1: Both nodes are leaves – plane-sweep their entries, sorted on the first axis.
+        if (nodeA.isLeaf() && nodeB.isLeaf()) {
+            // Only entries inside the intersection of the two node MBRs, grown by epsilon, can form a pair.
+            std::array<T, D> windowMin;
+            std::array<T, D> windowMax;
+            for (int d = 0; d < D; d++) {
+                windowMin[d] = lowered(std::max(nodeA.mbrMin[d], nodeB.mbrMin[d]), epsilon);
+                windowMax[d] = raised(std::min(nodeA.mbrMax[d], nodeB.mbrMax[d]), epsilon);
+            }
+
+            // Growing the entries of A by epsilon turns the distance test into the intersection
+            // test of the sweep, which then finds a superset of the pairs.
+            QueryScratch<D, T>& scratch = queryScratch<D, T>();
+            EntryRun<D, T>& runA = scratch.runA;
+            EntryRun<D, T>& runB = scratch.runB;
+            runA.assign(a, nodeA.entryCount, windowMin.data(), windowMax.data(), epsilon);
+            RTREE_STAT(stats.entriesTested += nodeA.entryCount; stats.entriesPruned += nodeA.entryCount - runA.count);
+            if (runA.count == 0) return;
+            runB.assign(b, nodeB.entryCount, windowMin.data(), windowMax.data());
+            RTREE_STAT(stats.entriesTested += nodeB.entryCount; stats.entriesPruned += nodeB.entryCount - runB.count);
+            if (runB.count == 0) return;
+
+            if (epsilon == 0) {
+                const uint32_t count = Kernels::sweepJoin(runA.entries(runA.ids.data()), runA.count,
+                                                          runB.entries(runB.ids.data()), runB.count, pairsA, pairsB);
+                RTREE_STAT(stats.results += count);
+                if (count > 0) {
+                    visit(pairsA, pairsB, count);
+                }
+                return;
+            }
+
+            // Sweep for the slots of the candidates, then keep those within epsilon at the corners.
+            const uint32_t candidates = Kernels::sweepJoin(runA.entries(runA.slots.data()), runA.count,
+                                                           runB.entries(runB.slots.data()), runB.count, pairsA, pairsB);
+            uint32_t count = 0;
+            for (uint32_t p = 0; p < candidates; p++) {
+                const Rectangle entryA = entryAt(a, pairsA[p]);
+                const Rectangle entryB = entryAt(b, pairsB[p]);
+                if (withinDistance(entryA.min.data(), entryA.max.data(), entryB.min.data(), entryB.max.data(), epsilon)) {
+                    pairsA[count] = entryA.id;
+                    pairsB[count] = entryB.id;
+                    count++;
+                }
+            }
+            RTREE_STAT(stats.results += count);
+            if (count > 0) {
+                visit(pairsA, pairsB, count);
+            }
+        }
+        // Case 2: Both nodes are internal.
+        else if (!nodeA.isLeaf() && !nodeB.isLeaf()) {
+            // For each child of nodeA, scan nodeB's inlined child MBRs.
+            // Note: This assumes nodeB's entries are sorted on the first axis.
+            for (int i = 0; i < nodeA.entryCount; i++) {
+                const Rectangle childA = entryAt(a, i);
+                // Scan from low until nodeB’s child starts beyond the end of childA.
+                for (int j = 0; j < nodeB.entryCount; j++) {
+                    if (b.min[0][j] > childA.max[0] + epsilon)
+                        break;
+                    RTREE_STAT(stats.entriesTested++);
+                    const Rectangle childB = entryAt(b, j);
+                    if (withinDistance(childA.min.data(), childA.max.data(), childB.min.data(), childB.max.data(), epsilon))
+                    {
+                        push(childA.id, childB.id);
                     }
-                } else if (entryDistance < m_distanceQueue.top().first) {
-                    m_distanceQueue.pop();
-                    m_distanceQueue.emplace(entryDistance, leaf.id);
-                    furthestNeighborDistance = entryDistance;
                 }
             }
         }
-        /*while (!m_distanceQueue.empty()) {
-            auto [dist, id] = m_distanceQueue.top();
-            std::cout << id << " : " << dist << std::endl;
-            m_distanceQueue.pop();
-        }*/
+        // Case 3: nodeA is internal, nodeB is a leaf.
+        else if (!nodeA.isLeaf() && nodeB.isLeaf()) {
+            for (int i = 0; i < nodeA.entryCount; i++) {
+                if (a.min[0][i] > nodeB.mbrMax[0] + epsilon)
+                    break;
+                RTREE_STAT(stats.entriesTested++);
+                const Rectangle childA = entryAt(a, i);
+                if (withinDistance(childA.min.data(), childA.max.data(), nodeB.mbrMin.data(), nodeB.mbrMax.data(), epsilon))
+                {
+                    push(childA.id, idB);
+                }
+            }
+        }
+        // Case 4: nodeA is a leaf, nodeB is internal.
+        else {
+            for (int j = 0; j < nodeB.entryCount; j++) {
+                if (b.min[0][j] > nodeA.mbrMax[0] + epsilon)
+                    break;
+                RTREE_STAT(stats.entriesTested++);
+                const Rectangle childB = entryAt(b, j);
+                if (withinDistance(nodeA.mbrMin.data(), nodeA.mbrMax.data(), childB.min.data(), childB.max.data(), epsilon))
+                {
+                    push(idA, childB.id);
+                }
+            }
+        }
     }
 
-    void RTreeBulkLoad::join(RTreeBulkLoad& rtreeB) {
-        std::map<int, std::vector<int>> m_joinRectangles;
-        std::stack<std::pair<Node*, Node*>> nodePairs;
-        nodePairs.emplace(this->m_root, rtreeB.m_root);
+    template<int D, typename T, int Capacity>
+    template<typename PairVisitor>
+    void BasicRTree<D, T, Capacity>::joinTraverse(const BasicRTree& rtreeB, Distance epsilon, PairVisitor&& visit) const {
+        QueryScratch<D, T>& scratch = queryScratch<D, T>();
+        std::vector<std::pair<int, int>>& nodePairs = scratch.nodePairs;
+        std::vector<int>& pairsA = scratch.pairsA;
+        std::vector<int>& pairsB = scratch.pairsB;
+        nodePairs.clear();
+        pairsA.resize(static_cast<std::size_t>(m_capacity) * rtreeB.m_capacity + SIMD_WIDTH);
+        pairsB.resize(pairsA.size());
+        RTREE_STAT(scratch.stats.queries++);
+
+        nodePairs.emplace_back(this->m_rootNodeId, rtreeB.m_rootNodeId);
 
+        auto push = [&nodePairs](int idA, int idB) { nodePairs.emplace_back(idA, idB); };
         while (!nodePairs.empty()) {
-            auto [nodeA, nodeB] = nodePairs.top();
-            nodePairs.pop();
-
-            // Prune if the two MBRs do not intersect.
-            if (!intersects(
-                    nodeA->mbrMinX, nodeA->mbrMinY, nodeA->mbrMaxX, nodeA->mbrMaxY,
-                    nodeB->mbrMinX, nodeB->mbrMinY, nodeB->mbrMaxX, nodeB->mbrMaxY))
-            {
+            auto [idA, idB] = nodePairs.back();
+            nodePairs.pop_back();
+            joinPair(rtreeB, epsilon, idA, idB, pairsA.data(), pairsB.data(), push, visit);
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    template<typename PairVisitor>
+    void BasicRTree<D, T, Capacity>::parallelJoinTraverse(const BasicRTree& rtreeB, Distance epsilon, ThreadPool& pool,
+                                                PairVisitor&& visit) const {
+        using NodePair = std::pair<int, int>;
+        const int workers = pool.size();
+        RTREE_STAT(queryScratch<D, T>().stats.queries++);
+
+        // Expand the top of both trees breadth-first until there are enough independent
+        // node pairs to keep every worker busy. Leaf pairs are carried over unexpanded.
+        std::vector<NodePair> frontier{{m_rootNodeId, rtreeB.m_rootNodeId}};
+        std::vector<NodePair> next;
+        const std::size_t target = static_cast<std::size_t>(workers) * JOIN_TASKS_PER_WORKER;
+        while (frontier.size() < target) {
+            next.clear();
+            bool expanded = false;
+            auto push = [&next](int idA, int idB) { next.emplace_back(idA, idB); };
+            auto noLeafPairs = [](const int*, const int*, uint32_t) {};
+            for (const auto& [idA, idB] : frontier) {
+                if (m_nodes.node(idA).isLeaf() && rtreeB.m_nodes.node(idB).isLeaf()) {
+                    next.emplace_back(idA, idB);
+                } else {
+                    joinPair(rtreeB, epsilon, idA, idB, nullptr, nullptr, push, noLeafPairs);
+                    expanded = true;
+                }
+            }
+            frontier.swap(next);
+            if (!expanded) break;
+        }
+
+        // Deal the frontier round-robin, then let idle workers steal from the busy ones.
+        std::vector<WorkStealingDeque<NodePair>> deques(workers);
+        for (std::size_t i = 0; i < frontier.size(); i++) {
+            deques[i % workers].push(frontier[i]);
+        }
+        std::atomic<std::size_t> pending{frontier.size()};
+        const std::size_t pairCapacity = static_cast<std::size_t>(m_capacity) * rtreeB.m_capacity + SIMD_WIDTH;
+
+        pool.run([&](int worker) {
+            QueryScratch<D, T>& scratch = queryScratch<D, T>();
+            std::vector<int>& pairsA = scratch.pairsA;
+            std::vector<int>& pairsB = scratch.pairsB;
+            pairsA.resize(pairCapacity);
+            pairsB.resize(pairCapacity);
+
+            WorkStealingDeque<NodePair>& own = deques[worker];
+            auto push = [&](int idA, int idB) {
+                pending.fetch_add(1, std::memory_order_relaxed);
+                own.push({idA, idB});
+            };
+            auto emit = [&](const int* idsA, const int* idsB, uint32_t count) {
+                visit(idsA, idsB, count, worker);
+            };
+
+            NodePair task;
+            while (true) {
+                bool found = own.pop(task);
+                for (int i = 1; !found && i < workers; i++) {
+                    found = deques[(worker + i) % workers].steal(task);
+                }
+                if (!found) {
+                    if (pending.load(std::memory_order_acquire) == 0) return;
+                    std::this_thread::yield();
+                    continue;
+                }
+                joinPair(rtreeB, epsilon, task.first, task.second, pairsA.data(), pairsB.data(), push, emit);
+                pending.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        });
+        RTREE_STAT(gatherStats<D, T>(pool));
+    }
+
+    template<int D, typename T, int Capacity>
+    uint64_t BasicRTree<D, T, Capacity>::join(const BasicRTree& rtreeB, std::vector<std::pair<int, int>>& results) const {
+        const std::size_t start = results.size();
+        joinTraverse(rtreeB, 0, [&results](const int* idsA, const int* idsB, uint32_t count) {
+            for (uint32_t i = 0; i < count; i++) {
+                results.emplace_back(idsA[i], idsB[i]);
+            }
+        });
+        return results.size() - start;
+    }
+
+    template<int D, typename T, int Capacity>
+    uint64_t BasicRTree<D, T, Capacity>::join(const BasicRTree& rtreeB, JoinSink& sink) const {
+        return distanceJoin(rtreeB, 0, sink);
+    }
+
+    template<int D, typename T, int Capacity>
+    uint64_t BasicRTree<D, T, Capacity>::distanceJoin(const BasicRTree& rtreeB, Distance epsilon, JoinSink& sink) const {
+        uint64_t total = 0;
+        joinTraverse(rtreeB, epsilon, [&](const int* idsA, const int* idsB, uint32_t count) {
+            sink.accept(idsA, idsB, count);
+            total += count;
+        });
+        return total;
+    }
+
+    template<int D, typename T, int Capacity>
+    uint64_t BasicRTree<D, T, Capacity>::joinCount(const BasicRTree& rtreeB) const {
+        uint64_t total = 0;
+        joinTraverse(rtreeB, 0, [&total](const int*, const int*, uint32_t count) {
+            total += count;
+        });
+        return total;
+    }
+
+    template<int D, typename T, int Capacity>
+    uint64_t BasicRTree<D, T, Capacity>::join(const BasicRTree& rtreeB, std::vector<std::pair<int, int>>& results,
+                                    ThreadPool& pool) const {
+        std::vector<std::vector<std::pair<int, int>>> buffers(pool.size());
+        parallelJoinTraverse(rtreeB, 0, pool, [&buffers](const int* idsA, const int* idsB, uint32_t count, int worker) {
+            auto& buffer = buffers[worker];
+            for (uint32_t i = 0; i < count; i++) {
+                buffer.emplace_back(idsA[i], idsB[i]);
+            }
+        });
+
+        // Merge the per-worker buffers.
+        const std::size_t start = results.size();
+        std::size_t total = 0;
+        for (const auto& buffer : buffers) total += buffer.size();
+        results.reserve(start + total);
+        for (const auto& buffer : buffers) {
+            results.insert(results.end(), buffer.begin(), buffer.end());
+        }
+        return total;
+    }
+
+    template<int D, typename T, int Capacity>
+    uint64_t BasicRTree<D, T, Capacity>::join(const BasicRTree& rtreeB, JoinSink& sink, ThreadPool& pool) const {
+        return distanceJoin(rtreeB, 0, sink, pool);
+    }
+
+    template<int D, typename T, int Capacity>
+    uint64_t BasicRTree<D, T, Capacity>::distanceJoin(const BasicRTree& rtreeB, Distance epsilon, JoinSink& sink,
+                                            ThreadPool& pool) const {
+        struct Buffer {
+            std::vector<int> idsA;
+            std::vector<int> idsB;
+        };
+        std::vector<Buffer> buffers(pool.size());
+        std::mutex sinkMutex;
+        std::atomic<uint64_t> total{0};
+
+        auto flush = [&](Buffer& buffer) {
+            if (buffer.idsA.empty()) return;
+            std::lock_guard<std::mutex> lock(sinkMutex);
+            sink.accept(buffer.idsA.data(), buffer.idsB.data(), static_cast<uint32_t>(buffer.idsA.size()));
+            total.fetch_add(buffer.idsA.size(), std::memory_order_relaxed);
+            buffer.idsA.clear();
+            buffer.idsB.clear();
+        };
+
+        parallelJoinTraverse(rtreeB, epsilon, pool, [&](const int* idsA, const int* idsB, uint32_t count, int worker) {
+            Buffer& buffer = buffers[worker];
+            buffer.idsA.insert(buffer.idsA.end(), idsA, idsA + count);
+            buffer.idsB.insert(buffer.idsB.end(), idsB, idsB + count);
+            if (buffer.idsA.size() >= JOIN_FLUSH_PAIRS) flush(buffer);
+        });
+        for (auto& buffer : buffers) flush(buffer);
+        return total.load();
+    }
+
+    template<int D, typename T, int Capacity>
+    uint64_t BasicRTree<D, T, Capacity>::joinCount(const BasicRTree& rtreeB, ThreadPool& pool) const {
+        struct alignas(64) Counter {
+            uint64_t value = 0;
+        };
+        std::vector<Counter> counters(pool.size());
+        parallelJoinTraverse(rtreeB, 0, pool, [&counters](const int*, const int*, uint32_t count, int worker) {
+            counters[worker].value += count;
+        });
+        uint64_t total = 0;
+        for (const auto& counter : counters) total += counter.value;
+        return total;
+    }
+
+    template<int D, typename T, int Capacity>
+    template<typename PairVisitor>
+    void BasicRTree<D, T, Capacity>::nearestJoinLeaf(const BasicRTree& rtreeB, int k, const Node& leaf,
+                                           PairVisitor&& visit) const {
+        QueryScratch<D, T>& scratch = queryScratch<D, T>();
+        const NodeEntries a = m_nodes.entries(leaf.nodeId);
+        const int queries = leaf.entryCount;
+        const Distance infinity = std::numeric_limits<Distance>::infinity();
+
+        // The query points are the entry centres; the group is pruned with the box around them.
+        std::vector<Distance>& points = scratch.queryPoints;
+        points.resize(static_cast<std::size_t>(queries) * D);
+        std::array<Distance, D> groupMin;
+        std::array<Distance, D> groupMax;
+        groupMin.fill(std::numeric_limits<Distance>::max());
+        groupMax.fill(std::numeric_limits<Distance>::lowest());
+        for (int q = 0; q < queries; q++) {
+            for (int d = 0; d < D; d++) {
+                const Distance c = (static_cast<Distance>(a.min[d][q]) + a.max[d][q]) / 2;
+                points[static_cast<std::size_t>(q) * D + d] = c;
+                groupMin[d] = std::min(groupMin[d], c);
+                groupMax[d] = std::max(groupMax[d], c);
+            }
+        }
+
+        // One max-heap of k candidates per query, and the k-th distance of each once it is full.
+        std::vector<std::pair<Distance, int>>& heaps = scratch.neighborHeaps;
+        std::vector<int>& heapSizes = scratch.heapSizes;
+        std::vector<Distance>& bounds = scratch.queryBounds;
+        heaps.resize(static_cast<std::size_t>(queries) * k);
+        heapSizes.assign(queries, 0);
+        bounds.assign(queries, infinity);
+        Distance groupBound = infinity;
+
+        std::vector<Distance>& candidateDistances = scratch.candidateDistances;
+        std::vector<int>& candidateSlots = scratch.candidateSlots;
+        candidateDistances.resize(rtreeB.m_nodes.stride());
+        candidateSlots.resize(rtreeB.m_nodes.stride());
+
+        using NodePair = std::pair<Distance, int>;
+        std::vector<NodePair>& nodeQueue = scratch.nodeQueue;
+        nodeQueue.clear();
+        const auto nodeOrder = std::greater<NodePair>();
+        nodeQueue.emplace_back(0, rtreeB.m_rootNodeId);
+
+        while (!nodeQueue.empty()) {
+            std::pop_heap(nodeQueue.begin(), nodeQueue.end(), nodeOrder);
+            const auto [dist, nodeId] = nodeQueue.back();
+            nodeQueue.pop_back();
+            RTREE_STAT(scratch.stats.heapOperations++);
+
+            // No query of the group can improve on its k-th neighbour any more.
+            if (dist >= groupBound) {
+                RTREE_STAT(scratch.stats.entriesPruned += nodeQueue.size() + 1);
+                break;
+            }
+
+            const Node& n = rtreeB.m_nodes.node(nodeId);
+            const NodeEntries e = rtreeB.m_nodes.entries(nodeId);
+            RTREE_STAT(scratch.stats.visit(n.level));
+
+            if (!n.isLeaf()) {
+                const uint32_t candidates = Kernels::filterDistance(e, n.entryCount, groupMin.data(), groupMax.data(),
+                                                                    groupBound, candidateDistances.data(),
+                                                                    candidateSlots.data());
+                RTREE_STAT(scratch.stats.entriesTested += n.entryCount; scratch.stats.entriesPruned += n.entryCount - candidates;
+                           scratch.stats.heapOperations += candidates);
+                for (uint32_t i = 0; i < candidates; i++) {
+                    nodeQueue.emplace_back(candidateDistances[i], e.ids[candidateSlots[i]]);
+                    std::push_heap(nodeQueue.begin(), nodeQueue.end(), nodeOrder);
+                }
                 continue;
             }
 
-            // Case 1: Both nodes are leaves – do pairwise comparisons.
-            if (nodeA->isLeaf() && nodeB->isLeaf()) {
-                for (const auto leafA : nodeA->leafs) {
-                    for (const auto leafB : nodeB->leafs) {
-                        if (intersects(
-                                leafA.minX, leafA.minY, leafA.maxX, leafA.maxY,
-                                leafB.minX, leafB.minY, leafB.maxX, leafB.maxY))
-                        {
-                            m_joinRectangles[leafA.id].push_back(leafB.id);
-                        }
+            for (int q = 0; q < queries; q++) {
+                const Distance* point = points.data() + static_cast<std::size_t>(q) * D;
+                Distance& bound = bounds[q];
+                if (Rectangle::distance(n.mbrMin.data(), n.mbrMax.data(), point) >= bound) {
+                    RTREE_STAT(scratch.stats.entriesPruned += n.entryCount);
+                    continue;
+                }
+
+                const uint32_t candidates = Kernels::filterDistance(e, n.entryCount, point, bound,
+                                                                    candidateDistances.data(), candidateSlots.data());
+                RTREE_STAT(scratch.stats.entriesTested += n.entryCount; scratch.stats.entriesPruned += n.entryCount - candidates);
+                std::pair<Distance, int>* heap = heaps.data() + static_cast<std::size_t>(q) * k;
+                int& size = heapSizes[q];
+                for (uint32_t i = 0; i < candidates; i++) {
+                    const Distance entryDistance = candidateDistances[i];
+                    if (size < k) {
+                        heap[size++] = {entryDistance, e.ids[candidateSlots[i]]};
+                        std::push_heap(heap, heap + size);
+                        RTREE_STAT(scratch.stats.heapOperations++);
+                    } else if (entryDistance < bound) {
+                        std::pop_heap(heap, heap + k);
+                        heap[k - 1] = {entryDistance, e.ids[candidateSlots[i]]};
+                        std::push_heap(heap, heap + k);
+                        RTREE_STAT(scratch.stats.heapOperations += 2);
+                    } else {
+                        RTREE_STAT(scratch.stats.entriesPruned++);
+                        continue;
+                    }
+                    if (size == k) {
+                        bound = heap[0].first;
                     }
                 }
             }
-            // Case 2: Both nodes are internal.
-            else if (!nodeA->isLeaf() && !nodeB->isLeaf()) {
-                // For each child of nodeA, use binary search in nodeB's sorted entries.
-                // Note: This assumes nodeB's entries are sorted by minX.
-                for (const auto childA : nodeA->children) {
-                    // Scan from low until nodeB’s child's minX is beyond childA’s maxX.
-                    for (const auto childB : nodeB->children) {
-                        if (childB->mbrMinX > childA->mbrMaxX)
-                            break;
-                        if (intersects(
-                                childA->mbrMinX, childA->mbrMinY, childA->mbrMaxX, childA->mbrMaxY,
-                                childB->mbrMinX, childB->mbrMinY, childB->mbrMaxX, childB->mbrMaxY))
-                        {
-                            nodePairs.emplace(childA, childB);
-                        }
+            groupBound = *std::max_element(bounds.begin(), bounds.end());
+        }
+
+        // Emit the neighbours of every query in ascending distance order.
+        std::vector<int>& pairsA = scratch.pairsA;
+        std::vector<int>& pairsB = scratch.pairsB;
+        pairsA.clear();
+        pairsB.clear();
+        for (int q = 0; q < queries; q++) {
+            std::pair<Distance, int>* heap = heaps.data() + static_cast<std::size_t>(q) * k;
+            std::sort_heap(heap, heap + heapSizes[q]);
+            for (int i = 0; i < heapSizes[q]; i++) {
+                pairsA.push_back(a.ids[q]);
+                pairsB.push_back(heap[i].second);
+            }
+        }
+        RTREE_STAT(scratch.stats.results += pairsA.size());
+        if (!pairsA.empty()) {
+            visit(pairsA.data(), pairsB.data(), static_cast<uint32_t>(pairsA.size()));
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    uint64_t BasicRTree<D, T, Capacity>::nearestJoin(const BasicRTree& rtreeB, int k, JoinSink& sink) const {
+        if (k <= 0) return 0;
+        RTREE_STAT(queryScratch<D, T>().stats.queries++);
+
+        uint64_t total = 0;
+        forEachLeaf(m_rootNodeId, [&](const Node& leaf) {
+            nearestJoinLeaf(rtreeB, k, leaf, [&](const int* idsA, const int* idsB, uint32_t count) {
+                sink.accept(idsA, idsB, count);
+                total += count;
+            });
+        });
+        return total;
+    }
+
+    template<int D, typename T, int Capacity>
+    uint64_t BasicRTree<D, T, Capacity>::nearestJoin(const BasicRTree& rtreeB, int k, JoinSink& sink, ThreadPool& pool) const {
+        if (k <= 0) return 0;
+        RTREE_STAT(queryScratch<D, T>().stats.queries++);
+
+        std::vector<int> leaves;
+        forEachLeaf(m_rootNodeId, [&leaves](const Node& leaf) { leaves.push_back(leaf.nodeId); });
+
+        struct Buffer {
+            std::vector<int> idsA;
+            std::vector<int> idsB;
+        };
+        std::vector<Buffer> buffers(pool.size());
+        std::mutex sinkMutex;
+        std::atomic<uint64_t> total{0};
+
+        auto flush = [&](Buffer& buffer) {
+            if (buffer.idsA.empty()) return;
+            std::lock_guard<std::mutex> lock(sinkMutex);
+            sink.accept(buffer.idsA.data(), buffer.idsB.data(), static_cast<uint32_t>(buffer.idsA.size()));
+            total.fetch_add(buffer.idsA.size(), std::memory_order_relaxed);
+            buffer.idsA.clear();
+            buffer.idsB.clear();
+        };
+
+        // Consecutive leaves are handed out together, so a worker keeps revisiting the same part of rtreeB.
+        pool.parallelFor(leaves.size(), BATCH_GRAIN, [&](std::size_t begin, std::size_t end, int worker) {
+            Buffer& buffer = buffers[worker];
+            auto append = [&buffer](const int* idsA, const int* idsB, uint32_t count) {
+                buffer.idsA.insert(buffer.idsA.end(), idsA, idsA + count);
+                buffer.idsB.insert(buffer.idsB.end(), idsB, idsB + count);
+            };
+            for (std::size_t i = begin; i < end; i++) {
+                nearestJoinLeaf(rtreeB, k, m_nodes.node(leaves[i]), append);
+                if (buffer.idsA.size() >= JOIN_FLUSH_PAIRS) flush(buffer);
+            }
+        });
+        RTREE_STAT(gatherStats<D, T>(pool));
+        for (auto& buffer : buffers) flush(buffer);
+        return total.load();
+    }
+
+    namespace {
+
+        /**
+         * Buffers of unionVolume, one per axis, kept across the nodes of a tree.
+         */
+        template<int D, typename T>
+        struct UnionScratch {
+            std::array<std::vector<T>, D> coordinates;
+            std::array<std::vector<int>, D> spanning;
+            std::vector<std::pair<T, T>> spans;
+        };
+
+        /**
+         * Volume of the union of the given entries of a node over the axes from Axis on. On the
+         * last axis this is the covered length; on the others it sums, over the slabs between
+         * consecutive distinct bounds on the axis, the slab width times the union volume of the
+         * entries spanning the slab on the remaining axes.
+         */
+        template<int Axis, int D, typename T>
+        double unionVolume(const BasicNodeEntries<D, T>& e, const std::vector<int>& members, UnionScratch<D, T>& scratch) {
+            using Distance = DistanceType<T>;
+            if constexpr (Axis == D - 1) {
+                std::vector<std::pair<T, T>>& spans = scratch.spans;
+                spans.clear();
+                for (int i : members) {
+                    spans.emplace_back(e.min[Axis][i], e.max[Axis][i]);
+                }
+                std::sort(spans.begin(), spans.end());
+                double covered = 0;
+                T start = spans[0].first;
+                T end = spans[0].second;
+                for (const auto& [low, high] : spans) {
+                    if (low > end) {
+                        covered += static_cast<Distance>(end) - start;
+                        start = low;
                     }
+                    end = std::max(end, high);
                 }
-            }
-            // Case 3: nodeA is internal, nodeB is a leaf.
-            else if (!nodeA->isLeaf() && nodeB->isLeaf()) {
-                for (const auto childA : nodeA->children) {
-                    if (childA->mbrMinX > nodeB->mbrMaxX)
-                        break;
-                    if (intersects(
-                            childA->mbrMinX, childA->mbrMinY, childA->mbrMaxX, childA->mbrMaxY,
-                            nodeB->mbrMinX, nodeB->mbrMinY, nodeB->mbrMaxX, nodeB->mbrMaxY))
-                    {
-                        nodePairs.emplace(childA, nodeB);
+                covered += static_cast<Distance>(end) - start;
+                return covered;
+            } else {
+                std::vector<T>& bounds = scratch.coordinates[Axis];
+                bounds.clear();
+                for (int i : members) {
+                    bounds.push_back(e.min[Axis][i]);
+                    bounds.push_back(e.max[Axis][i]);
+                }
+                std::sort(bounds.begin(), bounds.end());
+                bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+                std::vector<int>& spanning = scratch.spanning[Axis];
+                double total = 0;
+                for (std::size_t s = 0; s + 1 < bounds.size(); s++) {
+                    spanning.clear();
+                    for (int i : members) {
+                        if (e.min[Axis][i] <= bounds[s] && e.max[Axis][i] >= bounds[s + 1]) {
+                            spanning.push_back(i);
+                        }
                     }
+                    if (spanning.empty()) continue;
+                    total += unionVolume<Axis + 1>(e, spanning, scratch) * (static_cast<double>(bounds[s + 1]) - bounds[s]);
                 }
+                return total;
             }
-            // Case 4: nodeA is a leaf, nodeB is internal.
-            else {
-                for (const auto childB : nodeB->children) {
-                    if (childB->mbrMinX > nodeA->mbrMaxX)
-                        break;
-                    if (intersects(
-                            nodeA->mbrMinX, nodeA->mbrMinY, nodeA->mbrMaxX, nodeA->mbrMaxY,
-                            childB->mbrMinX, childB->mbrMinY, childB->mbrMaxX, childB->mbrMaxY))
-                    {
-                        nodePairs.emplace(nodeA, childB);
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    TreeStats BasicRTree<D, T, Capacity>::stats() const {
+        TreeStats result;
+        result.capacity = m_capacity;
+        result.allocatedBytes = m_nodes.allocatedBytes();
+        if (m_nodes.size() == 0) return result;
+
+        const Node& root = m_nodes.node(m_rootNodeId);
+        result.height = root.level;
+        for (int level = 1; level <= root.level; level++) {
+            result.levels.push_back(LevelStats{level});
+        }
+
+        UnionScratch<D, T> unionScratch;
+        std::vector<int> members;
+        std::vector<int> nodeStack{m_rootNodeId};
+        const std::size_t stride = m_nodes.stride();
+
+        while (!nodeStack.empty()) {
+            const Node& n = m_nodes.node(nodeStack.back());
+            nodeStack.pop_back();
+            const NodeEntries e = m_nodes.entries(n.nodeId);
+            LevelStats& level = result.levels[n.level - 1];
+
+            level.nodes++;
+            level.entries += n.entryCount;
+            result.nodeBytes += sizeof(Node);
+            (n.isLeaf() ? result.leafArrayBytes : result.internalArrayBytes) += 2 * D * stride * sizeof(T);
+            result.idArrayBytes += stride * sizeof(int);
+            result.unusedSlotBytes += (stride - n.entryCount) * (2 * D * sizeof(T) + sizeof(int));
+            if (n.entryCount == 0) continue;
+
+            double nodeArea = 1;
+            for (int d = 0; d < D; d++) {
+                nodeArea *= static_cast<Distance>(n.mbrMax[d]) - n.mbrMin[d];
+            }
+            members.resize(n.entryCount);
+            for (int i = 0; i < n.entryCount; i++) members[i] = i;
+            level.area += nodeArea;
+            level.deadSpace += std::max(0.0, nodeArea - unionVolume<0>(e, members, unionScratch));
+            if (n.isLeaf()) continue;
+
+            // Overlap between the children, accounted to their level. The entries are sorted on the first axis.
+            LevelStats& children = result.levels[n.level - 2];
+            for (int i = 0; i < n.entryCount; i++) {
+                nodeStack.push_back(e.ids[i]);
+                for (int j = i + 1; j < n.entryCount && e.min[0][j] <= e.max[0][i]; j++) {
+                    double shared = static_cast<Distance>(std::min(e.max[0][i], e.max[0][j])) - e.min[0][j];
+                    for (int d = 1; d < D && shared > 0; d++) {
+                        const Distance extent = static_cast<Distance>(std::min(e.max[d][i], e.max[d][j]))
+                                                - std::max(e.min[d][i], e.min[d][j]);
+                        shared = extent > 0 ? shared * extent : 0;
                     }
+                    children.overlap += shared;
                 }
             }
         }
+
+        uint64_t slots = 0;
+        for (LevelStats& level : result.levels) {
+            level.fillFactor = level.nodes > 0 ? static_cast<double>(level.entries) / (level.nodes * m_capacity) : 0;
+            result.nodes += level.nodes;
+            slots += level.entries;
+            result.area += level.area;
+            result.overlap += level.overlap;
+            result.deadSpace += level.deadSpace;
+        }
+        result.entries = result.levels.front().entries;
+        result.fillFactor = result.nodes > 0 ? static_cast<double>(slots) / (result.nodes * m_capacity) : 0;
+        return result;
+    }
+
+    template<int D, typename T, int Capacity>
+    QueryStats BasicRTree<D, T, Capacity>::takeStats() {
+        QueryStats& scratchStats = queryScratch<D, T>().stats;
+        const QueryStats stats = scratchStats;
+        scratchStats = QueryStats();
+        return stats;
     }
 
-} // namespace rtree
\ No newline at end of file
+    template class BasicRTree<2, float>;
+    template class BasicRTree<2, double>;
+    template class BasicRTree<2, int32_t>;
+    template class BasicRTree<3, float>;
+    template class BasicRTree<3, double>;
+    template class BasicRTree<3, int32_t>;
+
+    template class BasicRTree<2, float, 16>;
+    template class BasicRTree<2, float, 32>;
+    template class BasicRTree<2, float, 64>;
+    template class BasicRTree<2, float, 128>;
+    template class BasicRTree<3, float, 16>;
+    template class BasicRTree<3, float, 32>;
+    template class BasicRTree<3, float, 64>;
+    template class BasicRTree<3, float, 128>;
+
+    template void BasicRTree<2, float>::bulkLoad<2, float, void>(const RectangleRecord*, std::size_t);
+    template void BasicRTree<2, float>::bulkLoad<2, float, void>(const RectangleRecord*, std::size_t, ThreadPool&);
+    template void BasicRTree<2, float, 16>::bulkLoad<2, float, void>(const RectangleRecord*, std::size_t);
+    template void BasicRTree<2, float, 16>::bulkLoad<2, float, void>(const RectangleRecord*, std::size_t, ThreadPool&);
+    template void BasicRTree<2, float, 32>::bulkLoad<2, float, void>(const RectangleRecord*, std::size_t);
+    template void BasicRTree<2, float, 32>::bulkLoad<2, float, void>(const RectangleRecord*, std::size_t, ThreadPool&);
+    template void BasicRTree<2, float, 64>::bulkLoad<2, float, void>(const RectangleRecord*, std::size_t);
+    template void BasicRTree<2, float, 64>::bulkLoad<2, float, void>(const RectangleRecord*, std::size_t, ThreadPool&);
+    template void BasicRTree<2, float, 128>::bulkLoad<2, float, void>(const RectangleRecord*, std::size_t);
+    template void BasicRTree<2, float, 128>::bulkLoad<2, float, void>(const RectangleRecord*, std::size_t, ThreadPool&);
+
+} // namespace rtree
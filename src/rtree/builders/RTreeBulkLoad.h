@@ -6,18 +6,83 @@
 #include <cmath>
 #include <queue>
 #include <stack>
-#include <fstream>
-#include <map>
+#include <type_traits>
 
 #include "../structures/Node.h"
+#include "../structures/NodeStore.h"
 #include "../structures/Rectangle.h"
+#include "../structures/QueryStats.h"
+#include "../structures/Results.h"
+#include "../structures/TreeStats.h"
+#include "../structures/JoinOutput.h"
+#include "../kernels/NodeKernels.h"
+#include "../parallel/ThreadPool.h"
+#include "../io/IndexFile.h"
+#include "../io/RectangleFile.h"
 
 #ifndef RTREEBULKLOAD_H
 #define RTREEBULKLOAD_H
 
 namespace rtree {
 
-class RTreeBulkLoad {
+/**
+ * @brief How bulkLoad packs rectangles into nodes.
+ */
+enum class BulkLoadMethod {
+    /** Sort-tile-recursive: slabs on the first axis, each tiled on the next axes in turn. */
+    STR,
+    /** Hilbert packing: nodes filled in the Hilbert order of the rectangle centres. */
+    HILBERT
+};
+
+template<typename Code>
+class CompactRTree;
+template<int D, typename T, int Capacity>
+class BasicNearestIterator;
+
+/**
+ * @brief R-tree over rectangles with D coordinates of type T.
+ *
+ * Every dimension count and coordinate type shares the same node layout, bulk loading,
+ * updates, traversals, persistence and statistics; only the per-node kernels differ, through
+ * NodeKernels<D, T>, whose two-dimensional float specialisation runs on AVX. The member
+ * definitions live in RTreeBulkLoad.cpp and are instantiated there for D = 2 and 3 with
+ * float, double and int32_t coordinates.
+ *
+ * With a Capacity fixed at compile time, e.g. BasicRTree<3, float, 32>, every node holds its
+ * entries inline in its own block of the node store, and the range kernels bound the loop
+ * over the entries by Capacity while still stopping at the entry count, so unused slots are
+ * never read. Fixed
+ * capacities of 16, 32, 64 and 128 are instantiated for two- and three-dimensional float
+ * coordinates.
+ *
+ * Squared distances are returned as Distance: T for floating point coordinates, double for
+ * integer ones.
+ *
+ * @tparam D Number of dimensions.
+ * @tparam T Coordinate type.
+ * @tparam Capacity Maximum number of entries per node, or 0 to choose it at run time.
+ */
+template<int D, typename T, int Capacity = 0>
+class BasicRTree {
+
+    template<typename Code>
+    friend class CompactRTree;
+    friend class BasicNearestIterator<D, T, Capacity>;
+
+public:
+
+    using Rectangle = BasicRectangle<D, T>;
+    using Point = BasicPoint<D, T>;
+    using Distance = DistanceType<T>;
+    using Neighbor = BasicNeighbor<Distance>;
+
+private:
+
+    using Node = BasicNode<D, T>;
+    using NodeStore = BasicNodeStore<D, T, Capacity>;
+    using NodeEntries = BasicNodeEntries<D, T>;
+    using Kernels = NodeKernels<D, T, Capacity>;
 
     /**
      * @brief The ID of the root node of the R-tree.
@@ -36,141 +101,328 @@ class RTreeBulkLoad {
     int m_totalRectangles{};
 
     /**
-     * @brief A unique id for every node created in the tree.
+     * @brief Creates the leaf level of the R-tree from a set of rectangles.
+     *
+     * This function sorts the rectangles based on their spatial coordinates and
+     * groups them into leaf nodes, ensuring an optimal fill ratio.
+     *
+     * The primary sort runs in parallel and the slabs are sorted and packed concurrently;
+     * leaf ids are assigned per slab up front, so the result matches a sequential build.
      *
-     * This ID increments automatically with each new node, ensuring every
-     * node in the R-tree can be uniquely identified.
+     * @param rectangles The rectangles to be grouped into leaf nodes: Rectangle objects or
+     *        the records of a binary rectangle file.
+     * @param nodeCapacity The maximum number of entries a node can hold.
+     * @param pool The thread pool to build on.
+     * @return The ids of the created leaf nodes.
      */
-    int m_nextNodeId{};
+    template<typename Entry>
+    std::vector<int> createLeafLevel(std::vector<Entry>& rectangles, int nodeCapacity, ThreadPool& pool);
 
     /**
-     * @brief Retrieves a previously unused node ID, reusing deleted node IDs if available.
+     * @brief Creates the next level of the R-tree from a given set of nodes.
      *
-     * This function manages the node ID space for the R-tree. If there are any
-     * previously deleted nodes whose IDs can be recycled, it returns one of those.
-     * Otherwise, it increments the highest used node ID and returns a new one.
+     * This function groups child nodes into parent nodes, constructing the tree
+     * level by level until only a single root remains.
      *
-     * @return The new node ID.
+     * Parallelised the same way as createLeafLevel.
+     *
+     * @param nodes The ids of the nodes that need to be grouped.
+     * @param nodeCapacity The maximum number of entries a node can hold.
+     * @param pool The thread pool to build on.
+     * @return The ids of the newly created parent nodes.
      */
-    int getNextNodeId();
+    std::vector<int> createNextLevel(std::vector<int>& nodes, int nodeCapacity, ThreadPool& pool);
 
     /**
-     * @brief Creates the leaf level of the R-tree from a set of rectangles.
+     * @brief Creates the leaf level by Hilbert packing.
      *
-     * This function sorts the rectangles based on their spatial coordinates and
-     * groups them into leaf nodes, ensuring an optimal fill ratio.
+     * The centres of the rectangles are quantised over the dataset bounds, mapped to Hilbert
+     * keys and radix sorted; the rectangles are then reordered and packed into consecutive
+     * leaves in key order. Keys are computed and leaves filled in parallel.
      *
-     * @param rectangles A vector of rectangles to be grouped into leaf nodes.
+     * @param rectangles The rectangles to be grouped into leaf nodes, as for createLeafLevel.
      * @param nodeCapacity The maximum number of entries a node can hold.
-     * @return A vector of shared pointers to the created leaf nodes.
+     * @param pool The thread pool to build on.
+     * @return The ids of the created leaf nodes, in Hilbert order.
      */
-    std::vector<Node*> createLeafLevel(std::vector<Rectangle>& rectangles, int nodeCapacity);
+    template<typename Entry>
+    std::vector<int> createHilbertLeafLevel(std::vector<Entry>& rectangles, int nodeCapacity, ThreadPool& pool);
 
     /**
-     * @brief Creates the next level of the R-tree from a given set of nodes.
+     * @brief Packs consecutive runs of nodes into parents, keeping their order.
      *
-     * This function groups child nodes into parent nodes, constructing the tree
-     * level by level until only a single root remains.
+     * Used for the upper levels of a Hilbert-packed tree.
      *
-     * @param nodes A vector of shared pointers to nodes that need to be grouped.
+     * @param nodes The ids of the nodes that need to be grouped.
      * @param nodeCapacity The maximum number of entries a node can hold.
-     * @return A vector of shared pointers to the newly created parent nodes.
+     * @param pool The thread pool to build on.
+     * @return The ids of the newly created parent nodes.
      */
-    std::vector<Node*> createNextLevel(std::vector<Node*>& nodes, int nodeCapacity);
+    std::vector<int> packNextLevel(const std::vector<int>& nodes, int nodeCapacity, ThreadPool& pool);
 
     /**
-     * @brief Creates a new internal node with given child nodes.
+     * @brief Fills a new internal node with given child nodes.
      *
-     * This function initializes a new node at the specified level and adds entries
+     * This function initializes an allocated node at the specified level and adds entries
      * corresponding to its child nodes.
      *
-     * @param children A vector of shared pointers to child nodes.
+     * @param begin Iterator to the first child node id.
+     * @param end Iterator past the last child node id.
      * @param level The level of the new node in the R-tree.
-     * @return A shared pointer to the newly created node.
+     * @param nodeId The allocated id of the node.
      */
-    Node* createNode(std::vector<Node*>& children, int level);
+    void createNode(std::vector<int>::const_iterator begin, std::vector<int>::const_iterator end, int level, int nodeId);
 
     /**
      * @brief Creates a leaf node containing a subset of rectangles.
      *
      * This function initializes a leaf node and inserts rectangle entries into it.
      *
-     * @param rectangles A vector of rectangles to be added to the leaf node.
+     * @param rectangles The rectangles to be added to the leaf node, as for createLeafLevel.
      * @param start The starting index of the rectangles in the vector.
      * @param end The ending index (exclusive) of the rectangles in the vector.
-     * @return A shared pointer to the newly created leaf node.
+     * @param nodeId The allocated id of the leaf node.
      */
-    Node* createLeafNode(const std::vector<Rectangle>& rectangles, int start, int end);
+    template<typename Entry>
+    void createLeafNode(const std::vector<Entry>& rectangles, int start, int end, int nodeId);
 
     /**
-     * @brief Recursively retrieves all leaf entry IDs from the given node and its children.
+     * @brief Builds the tree from rectangles, replacing its contents; shared by the bulkLoad overloads.
      *
-     * If the node is a leaf node, its entry IDs are added to the vector.
-     * Otherwise, the method recurses into all children.
+     * @param rectangles The rectangles, as for createLeafLevel. Reordered in place by the packing.
+     * @param pool The thread pool to build on.
+     */
+    template<typename Entry>
+    void build(std::vector<Entry>& rectangles, ThreadPool& pool);
+
+    /**
+     * @brief Visits every leaf node below the given node.
+     *
+     * Used when a range fully contains an internal node: every entry below it is a result.
      *
-     * @param node The starting node.
-     * @param leafs Vector to store the collected leaf entry IDs.
+     * @param nodeId The starting node.
+     * @param visit Callable invoked with each leaf node.
      */
-    void getLeafs(Node* node, std::vector<int>& leafs);
+    template<typename LeafVisitor>
+    void forEachLeaf(int nodeId, LeafVisitor&& visit) const;
 
     /**
-     * @brief Sweeps through a small batch of leaf rectangles and finds those intersecting the query range.
+     * @brief Walks the tree for a range query and hands every relevant node to the visitor.
      *
-     * This method assumes a small window (batch) of leafs and performs a vertical sweep
-     * to collect intersecting rectangles into the results vector.
+     * Internal nodes are filtered with the inlined child MBRs. An internal node fully inside
+     * the range is visited with contained == true and not descended into: every entry below
+     * it is a result. Other nodes reaching the visitor are leaves whose entries still need to
+     * be swept.
      *
-     * @param leaf A single rectangle to check for intersection.
-     * @param rangeQ The query rectangle.
-     * @param start The starting index in the batch.
-     * @param size The size of the batch (1).
-     * @param results Vector to collect matching entry IDs.
-     * @param res_size Current size of the results vector (used for resizing).
+     * @param r The query range.
+     * @param visit Callable invoked as visit(const Node& node, bool contained).
      */
-    void sweepLeafs(Rectangle& leaf, const Rectangle& rangeQ, int start, int size, std::vector<int>& results, uint32_t& res_size);
+    template<typename LeafVisitor>
+    void rangeTraverse(const Rectangle& r, LeafVisitor&& visit) const;
 
     /**
-     * @brief Sweeps through a larger batch of leaf rectangles, identifying those intersecting the query range.
+     * @brief Sweeps the entries of a leaf node, collecting those intersecting the query range.
      *
-     * This method handles multiple leaf rectangles and checks them against the query rectangle.
-     * Results are collected into the provided results vector.
+     * The leaf stores its entries as coordinate arrays sorted by the minimum on the first
+     * axis; the sweep stops at the first entry starting past the range and writes the ids of
+     * the matching ones directly into the output buffer.
      *
      * @param rangeQ The query rectangle.
-     * @param leafs The vector of leaf rectangles to check.
-     * @param start The starting index within the leafs vector.
-     * @param size The number of rectangles to check.
-     * @param results Vector to collect matching entry IDs.
-     * @param res_size Current size of the results vector (used for resizing).
-     */
-    void sweepLeafsNext(const Rectangle& rangeQ, std::vector<Rectangle>& leafs, int start, int size, std::vector<int>& results, uint32_t& res_size);
-
-    /**
-     * @brief Checks if two rectangles (range and entry) intersect.
-     *
-     * @param rangeMinX Minimum X coordinate of the range rectangle.
-     * @param rangeMinY Minimum Y coordinate of the range rectangle.
-     * @param rangeMaxX Maximum X coordinate of the range rectangle.
-     * @param rangeMaxY Maximum Y coordinate of the range rectangle.
-     * @param rectMinX Minimum X coordinate of the entry rectangle.
-     * @param rectMinY Minimum Y coordinate of the entry rectangle.
-     * @param rectMaxX Maximum X coordinate of the entry rectangle.
-     * @param rectMaxY Maximum Y coordinate of the entry rectangle.
-     * @return True if the rectangles intersect, false otherwise.
-     */
-    static inline bool intersects(float rangeMinX, float rangeMinY, float rangeMaxX, float rangeMaxY,
-                                  float rectMinX, float rectMinY, float rectMaxX, float rectMaxY) {
-        return !(rectMaxX < rangeMinX || rectMinX > rangeMaxX ||
-                 rectMaxY < rangeMinY || rectMinY > rangeMaxY);
+     * @param leaf The leaf node to scan.
+     * @param out Output buffer with room for stride() ids.
+     * @return The number of ids written.
+     */
+    uint32_t sweepLeafs(const Rectangle& rangeQ, const Node& leaf, int* out) const;
+
+    /**
+     * @brief Walks both trees for a spatial join and hands the entry pairs within epsilon of each
+     * other to the visitor.
+     *
+     * Pairs are produced one leaf pair at a time as two parallel id arrays.
+     *
+     * @param rtreeB The second R-tree.
+     * @param epsilon Maximum distance between the rectangles of a pair; 0 joins intersecting rectangles.
+     * @param visit Callable invoked as visit(const int* idsA, const int* idsB, uint32_t count).
+     */
+    template<typename PairVisitor>
+    void joinTraverse(const BasicRTree& rtreeB, Distance epsilon, PairVisitor&& visit) const;
+
+    /**
+     * @brief Parallel version of joinTraverse.
+     *
+     * The top levels of both trees are expanded into independent node pairs, which the workers
+     * of the pool then consume through per-worker work-stealing deques. The order in which leaf
+     * pairs reach the visitor is unspecified.
+     *
+     * @param rtreeB The second R-tree.
+     * @param epsilon Maximum distance between the rectangles of a pair.
+     * @param pool The thread pool to run on.
+     * @param visit Callable invoked as visit(const int* idsA, const int* idsB, uint32_t count, int worker),
+     *              concurrently for different workers.
+     */
+    template<typename PairVisitor>
+    void parallelJoinTraverse(const BasicRTree& rtreeB, Distance epsilon, ThreadPool& pool, PairVisitor&& visit) const;
+
+    /**
+     * @brief Finds the k nearest entries of rtreeB for every entry of one leaf of this tree.
+     *
+     * @param rtreeB The tree the neighbours are taken from.
+     * @param k The number of neighbours per entry.
+     * @param leaf The leaf of this tree.
+     * @param visit Callable invoked once as visit(const int* idsA, const int* idsB, uint32_t count).
+     */
+    template<typename PairVisitor>
+    void nearestJoinLeaf(const BasicRTree& rtreeB, int k, const Node& leaf, PairVisitor&& visit) const;
+
+    /**
+     * @brief Joins one pair of nodes: leaf pairs go to the visitor, child pairs of internal
+     * nodes within epsilon of each other to push.
+     *
+     * Leaf entries are swept with the entries of this tree grown by epsilon, and for a positive
+     * epsilon the candidates are refined by their exact distance.
+     *
+     * @param rtreeB The second R-tree.
+     * @param epsilon Maximum distance between the rectangles of a pair.
+     * @param idA Node id in this tree.
+     * @param idB Node id in rtreeB.
+     * @param pairsA Scratch buffer with room for the product of both capacities plus SIMD_WIDTH.
+     * @param pairsB Scratch buffer with room for the product of both capacities plus SIMD_WIDTH.
+     * @param push Callable invoked as push(childA, childB) for every node pair still to be joined.
+     * @param visit Callable invoked as visit(const int* idsA, const int* idsB, uint32_t count).
+     */
+    template<typename PushPair, typename PairVisitor>
+    void joinPair(const BasicRTree& rtreeB, Distance epsilon, int idA, int idB, int* pairsA, int* pairsB,
+                  PushPair&& push, PairVisitor&& visit) const;
+
+    /**
+     * @brief Checks if two rectangles, given by their corners, are within a distance of each other.
+     *
+     * @param aMin Minimum corner of the first rectangle.
+     * @param aMax Maximum corner of the first rectangle.
+     * @param bMin Minimum corner of the second rectangle.
+     * @param bMax Maximum corner of the second rectangle.
+     * @param epsilon The distance.
+     * @return True if the minimum Euclidean distance between the rectangles is at most epsilon.
+     */
+    static inline bool withinDistance(const T* aMin, const T* aMax, const T* bMin, const T* bMax, Distance epsilon) {
+        if (epsilon == 0) {
+            return Rectangle::intersects(aMin, aMax, bMin, bMax);
+        }
+        Distance total = 0;
+        for (int d = 0; d < D; d++) {
+            const Distance gap = std::max(std::max(static_cast<Distance>(bMin[d]) - aMax[d],
+                                                   static_cast<Distance>(aMin[d]) - bMax[d]), Distance(0));
+            total += gap * gap;
+        }
+        return total <= epsilon * epsilon;
     }
 
     /**
-     * @brief A pointer to the root node of the R-tree.
-    */
-    Node* m_root;
+     * @brief Estimates the number of nodes a bulk load of the given size creates, so the
+     * node store can be reserved with a single allocation.
+     *
+     * @param rectangleCount The number of rectangles to be loaded.
+     * @return An upper bound on the number of nodes.
+     */
+    int estimateNodeCount(int rectangleCount) const;
 
     /**
-     * @return the total number of leafs stored in the R-tree.
+     * @brief Minimum number of entries of a node modified by remove before it is dissolved.
      */
-    int getLeafsSize() const;
+    int minEntries() const;
+
+    /**
+     * @brief Inserts an entry into a node of the given level (1 for rectangles).
+     *
+     * Follows the R*-tree: choose-subtree, then on overflow a forced reinsert the first time
+     * a level overflows during the current insertion, and a split afterwards.
+     *
+     * @param entry The entry to insert.
+     * @param level The level of the node that receives the entry.
+     * @param reinserted Per level, whether a forced reinsert already happened in this insertion.
+     */
+    void insertEntry(const Rectangle& entry, int level, std::vector<bool>& reinserted);
+
+    /**
+     * @brief Descends from the root to the node of the given level best suited to hold the entry.
+     *
+     * Above the leaves the child needing the least area enlargement is chosen; for the
+     * parents of leaves the one with the least overlap enlargement.
+     *
+     * @param entry The entry to place.
+     * @param level The level of the node to find.
+     * @param path Receives the node ids from the root down to the chosen node.
+     */
+    void chooseSubtree(const Rectangle& entry, int level, std::vector<int>& path) const;
+
+    /**
+     * @brief Adds an entry to the last node of path, treating a resulting overflow.
+     *
+     * @param path Node ids from the root to the node receiving the entry; consumed on splits.
+     * @param entry The entry to add.
+     * @param reinserted Per level, whether a forced reinsert already happened in this insertion.
+     */
+    void addToPath(std::vector<int>& path, const Rectangle& entry, std::vector<bool>& reinserted);
+
+    /**
+     * @brief Splits an overflowing set of entries with the R*-tree split: the axis with the
+     * least margin sum, then the distribution with the least overlap, then the least area.
+     *
+     * @param nodeId The overflowing node, which keeps the first group.
+     * @param entries The capacity + 1 entries to distribute.
+     * @return The id of the new sibling holding the second group.
+     */
+    int splitNode(int nodeId, std::vector<Rectangle>& entries);
+
+    /**
+     * @brief Refreshes the MBRs stored in the parents along a path after its last node changed.
+     *
+     * @param path Node ids from the root down to the changed node.
+     */
+    void adjustPath(const std::vector<int>& path);
+
+    /**
+     * @brief Replaces the entry of a child in its parent by the child's current MBR.
+     *
+     * @param parentId The parent node.
+     * @param childId The child node.
+     * @return False if the stored entry already matched the child's MBR.
+     */
+    bool updateChildEntry(int parentId, int childId);
+
+    /**
+     * @brief Finds the leaf holding an entry.
+     *
+     * @param id The id of the entry.
+     * @param mbr The rectangle of the entry.
+     * @param path Receives the node ids from the root down to the leaf.
+     * @return The slot of the entry in the leaf, or -1 if the tree does not hold it.
+     */
+    int findLeaf(int id, const Rectangle& mbr, std::vector<int>& path) const;
+
+    /**
+     * @brief Dissolves underfull nodes along a path after a removal and reinserts their entries,
+     * then shortens the tree while the root has a single child.
+     *
+     * @param path Node ids from the root down to the leaf an entry was removed from.
+     */
+    void condenseTree(const std::vector<int>& path);
+
+    /**
+     * @brief Collects the leaf entries below a node and releases the node and its subtree.
+     *
+     * @param nodeId The root of the subtree.
+     * @param entries Receives the leaf entries.
+     */
+    void dissolveSubtree(int nodeId, std::vector<Rectangle>& entries);
+
+    /**
+     * @brief The arena holding every node of the tree, addressed by node id.
+     *
+     * Nodes are laid out level by level from the leaves up and are released together
+     * when the tree is destroyed or rebuilt.
+     */
+    NodeStore m_nodes;
 
     /**
      * @brief The current height of the R-tree.
@@ -188,17 +440,70 @@ class RTreeBulkLoad {
      */
     const int m_capacity{};
 
+    /**
+     * @brief The packing strategy used by bulkLoad.
+     */
+    const BulkLoadMethod m_method = BulkLoadMethod::STR;
+
+    /**
+     * @brief The mapped index file the nodes live in when the tree was opened from disk.
+     *
+     * Null for trees built in memory; released when such a tree is rebuilt.
+     */
+    std::shared_ptr<MappedIndexFile> m_image;
+
+    /**
+     * @brief Constructor for a tree backed by a mapped index file.
+     *
+     * @param image The mapped index file.
+     */
+    explicit BasicRTree(std::shared_ptr<MappedIndexFile> image);
+
 public:
 
     /**
-     * @brief Constructor for RTreeBulkLoad.
+     * @brief Constructor for an empty tree.
      *
-     * Initializes an RTreeBulkLoad instance with the specified capacity, which defines
+     * Initializes a tree with the specified capacity, which defines
      * the maximum number of entries each node can hold.
      *
-     * @param capacity Maximum number of entries per node.
+     * @param capacity Maximum number of entries per node; ignored when Capacity fixes it.
+     * @param hugePages Back the node arena with transparent huge pages where available.
+     * @param method The packing strategy used by bulkLoad.
+     */
+    explicit BasicRTree(int capacity, bool hugePages = false, BulkLoadMethod method = BulkLoadMethod::STR);
+
+    /**
+     * @brief Constructor for an empty tree with the capacity fixed by Capacity.
+     *
+     * Pass Capacity to the capacity constructor for huge pages or another packing strategy.
+     */
+    template<int Fixed = Capacity, typename = std::enable_if_t<(Fixed > 0)>>
+    BasicRTree() : BasicRTree(Capacity) {}
+
+    /**
+     * @brief Opens a tree persisted with save().
+     *
+     * The index file is memory-mapped and queried in place, without any deserialisation;
+     * its pages are read lazily as queries touch them.
+     *
+     * @param indexPath Path of the index file.
+     * @throws std::runtime_error If the file cannot be mapped, was written by an incompatible build
+     *         or holds a tree of another dimension count or coordinate type.
+     */
+    explicit BasicRTree(const std::string& indexPath);
+
+    /**
+     * @brief Persists the tree as a position-independent index file that can be reopened
+     * with the indexPath constructor of the same BasicRTree<D, T, Capacity>.
+     *
+     * Nodes released by remove() are left out and the others renumbered, so the file of a
+     * tree that is reopened, updated and saved again keeps the size of its live nodes.
+     *
+     * @param path Path of the index file, created or truncated.
+     * @throws std::runtime_error If the file cannot be written.
      */
-    explicit RTreeBulkLoad(int capacity);
+    void save(const std::string& path) const;
 
     /**
     * @brief Bulk loads a set of rectangles (a given dataset) into the R-tree.
@@ -211,41 +516,311 @@ public:
     */
     void bulkLoad(std::vector<Rectangle>& rectangles);
 
+    /**
+    * @brief Bulk loads a set of rectangles into the R-tree using the workers of a thread pool.
+    *
+    * Produces exactly the same tree (node ids, order and contents) as the sequential bulkLoad.
+    *
+    * @param rectangles A vector of rectangles to be inserted into the R-tree.
+    * @param pool The thread pool to build on.
+    */
+    void bulkLoad(std::vector<Rectangle>& rectangles, ThreadPool& pool);
+
+    /**
+    * @brief Bulk loads the records of a binary rectangle file into the R-tree.
+    *
+    * The records, e.g. those of a MappedRectangleFile, are copied once into a buffer of
+    * 20-byte records that the STR or Hilbert packing sorts in place, without materialising
+    * Rectangle objects. Produces the same tree as bulkLoad of the same rectangles.
+    * Only available on two-dimensional float trees, as the records hold 2-D float coordinates.
+    *
+    * @param records The records.
+    * @param count The number of records.
+    */
+    template<int Dims = D, typename Coordinate = T,
+             typename = std::enable_if_t<Dims == 2 && std::is_same_v<Coordinate, float>>>
+    void bulkLoad(const RectangleRecord* records, std::size_t count);
+
+    /**
+    * @brief Bulk loads the records of a binary rectangle file using the workers of a thread pool.
+    *
+    * @param records The records.
+    * @param count The number of records.
+    * @param pool The thread pool to build on.
+    */
+    template<int Dims = D, typename Coordinate = T,
+             typename = std::enable_if_t<Dims == 2 && std::is_same_v<Coordinate, float>>>
+    void bulkLoad(const RectangleRecord* records, std::size_t count, ThreadPool& pool);
+
+    /**
+     * @brief Inserts a rectangle into the tree.
+     *
+     * Uses the R*-tree insertion: choose-subtree, forced reinsert and node splitting, so a
+     * bulk-loaded tree can absorb updates without a rebuild. Not safe concurrently with queries.
+     *
+     * @param rectangle The rectangle to insert.
+     */
+    void insert(const Rectangle& rectangle);
+
+    /**
+     * @brief Removes a rectangle from the tree.
+     *
+     * Underfull nodes along the way are dissolved and their entries reinserted (condense-tree).
+     * Not safe concurrently with queries.
+     *
+     * @param id The id of the rectangle.
+     * @param mbr The rectangle as it was inserted.
+     * @return True if the rectangle was found and removed.
+     */
+    bool remove(int id, const Rectangle& mbr);
+
     /**
      * @brief Performs a spatial join between two R-trees.
      *
-     * This function recursively traverses both R-trees, identifying entries whose
+     * This function traverses both R-trees, identifying entries whose
      * leafs (rectangles) intersect. Only nodes whose
      * minimum bounding rectangles overlap are further explored, ensuring a more
      * efficient join operation.
      *
      * @param rtreeB The second R-tree instance to join.
+     * @param results Vector the (idA, idB) pairs are appended to. Reusing it across calls
+     *                avoids allocating once it has grown to the output size.
+     * @return The number of pairs appended.
      */
-    void join(RTreeBulkLoad& rtreeB);
+    uint64_t join(const BasicRTree& rtreeB, std::vector<std::pair<int, int>>& results) const;
+
+    /**
+     * @brief Performs a spatial join between two R-trees, streaming the pairs to a sink.
+     *
+     * @param rtreeB The second R-tree instance to join.
+     * @param sink Receives the (idA, idB) pairs, one batch per joined leaf pair.
+     * @return The number of pairs emitted.
+     */
+    uint64_t join(const BasicRTree& rtreeB, JoinSink& sink) const;
+
+    /**
+     * @brief Counts the intersecting pairs of a spatial join without materialising them.
+     *
+     * @param rtreeB The second R-tree instance to join.
+     * @return The number of intersecting (idA, idB) pairs.
+     */
+    uint64_t joinCount(const BasicRTree& rtreeB) const;
+
+    /**
+     * @brief Performs a spatial join between two R-trees on the workers of a thread pool.
+     *
+     * Independent node pairs below the top levels are scheduled with work stealing and
+     * each worker collects its pairs in its own buffer; the buffers are appended to results
+     * at the end. The order of the pairs is unspecified.
+     *
+     * @param rtreeB The second R-tree instance to join.
+     * @param results Vector the (idA, idB) pairs are appended to.
+     * @param pool The thread pool to run on.
+     * @return The number of intersecting pairs found.
+     */
+    uint64_t join(const BasicRTree& rtreeB, std::vector<std::pair<int, int>>& results, ThreadPool& pool) const;
+
+    /**
+     * @brief Performs a parallel spatial join, streaming the pairs to a sink.
+     *
+     * Workers buffer their pairs and hand them to the sink in large batches, one worker at a
+     * time, so the sink does not need to be thread-safe.
+     *
+     * @param rtreeB The second R-tree instance to join.
+     * @param sink Receives the (idA, idB) pairs.
+     * @param pool The thread pool to run on.
+     * @return The number of intersecting pairs found.
+     */
+    uint64_t join(const BasicRTree& rtreeB, JoinSink& sink, ThreadPool& pool) const;
+
+    /**
+     * @brief Counts the intersecting pairs of a spatial join on the workers of a thread pool.
+     *
+     * @param rtreeB The second R-tree instance to join.
+     * @param pool The thread pool to run on.
+     * @return The number of intersecting pairs.
+     */
+    uint64_t joinCount(const BasicRTree& rtreeB, ThreadPool& pool) const;
+
+    /**
+     * @brief Performs a distance join: finds every pair of entries whose rectangles lie within
+     * epsilon of each other.
+     *
+     * Node pairs are pruned by the minimum distance between their MBRs. Leaf pairs use the
+     * plane sweep of join with the entries of this tree grown by epsilon, and the candidates it
+     * finds are refined by their exact distance, so no grown copy of either tree is built.
+     *
+     * @param rtreeB The second R-tree instance to join.
+     * @param epsilon Maximum Euclidean distance between the rectangles of a pair (not squared).
+     * @param sink Receives the (idA, idB) pairs, one batch per joined leaf pair.
+     * @return The number of pairs emitted.
+     */
+    uint64_t distanceJoin(const BasicRTree& rtreeB, Distance epsilon, JoinSink& sink) const;
+
+    /**
+     * @brief Performs a distance join on the workers of a thread pool, buffering the pairs as
+     * the parallel join does.
+     *
+     * @param rtreeB The second R-tree instance to join.
+     * @param epsilon Maximum Euclidean distance between the rectangles of a pair (not squared).
+     * @param sink Receives the (idA, idB) pairs.
+     * @param pool The thread pool to run on.
+     * @return The number of pairs emitted.
+     */
+    uint64_t distanceJoin(const BasicRTree& rtreeB, Distance epsilon, JoinSink& sink, ThreadPool& pool) const;
+
+    /**
+     * @brief Performs an all-k-nearest-neighbour join: finds, for every entry of this tree, the k
+     * entries of rtreeB nearest to the centre of its rectangle.
+     *
+     * The entries of each leaf of this tree are answered together by a single best-first
+     * traversal of rtreeB. Nodes of rtreeB are ordered by their distance to the box around the
+     * leaf's centres and pruned against the largest k-th distance of the group, and the entries
+     * of a reached leaf are filtered per query against that query's own k-th distance.
+     * Distances are the squared distances nearestN uses.
+     *
+     * @param rtreeB The tree the neighbours are taken from.
+     * @param k The number of neighbours per entry.
+     * @param sink Receives the (idA, idB) pairs, one batch per leaf of this tree, with the
+     *             neighbours of each entry in ascending distance.
+     * @return The number of pairs emitted.
+     */
+    uint64_t nearestJoin(const BasicRTree& rtreeB, int k, JoinSink& sink) const;
+
+    /**
+     * @brief Performs an all-k-nearest-neighbour join on the workers of a thread pool.
+     *
+     * The leaves of this tree are shared out between the workers, which buffer their pairs and
+     * hand them to the sink one worker at a time. The order of the batches is unspecified.
+     *
+     * @param rtreeB The tree the neighbours are taken from.
+     * @param k The number of neighbours per entry.
+     * @param sink Receives the (idA, idB) pairs.
+     * @param pool The thread pool to run on.
+     * @return The number of pairs emitted.
+     */
+    uint64_t nearestJoin(const BasicRTree& rtreeB, int k, JoinSink& sink, ThreadPool& pool) const;
 
     /**
      * @brief Performs a range query on the R-tree.
      *
      * Searches for all leaf entries (rectangles) that are contained or intersect with the given range.
-     * Results are collected into an internal vector (m_ids).
+     * The traversal state is kept in per-thread scratch buffers, so a query into a reused
+     * results vector performs no heap allocation.
+     *
+     * @param range The query range.
+     * @param results Vector the ids of the matching entries are appended to.
+     * @return The number of ids appended.
+     */
+    uint32_t range(const Rectangle& range, std::vector<int>& results) const;
+
+    /**
+     * @brief Performs a range query on the R-tree, streaming the results to a sink.
+     *
+     * @param range The query range.
+     * @param sink Receives the ids of the matching entries, one batch per visited leaf.
+     * @return The number of ids emitted.
+     */
+    uint32_t range(const Rectangle& range, ResultSink& sink) const;
+
+    /**
+     * @brief Counts the leaf entries intersecting a range without materialising their ids.
+     *
+     * Subtrees fully inside the range add their stored entry count without being visited, so
+     * only the nodes on the boundary of the range are descended into.
+     *
+     * @param range The query range.
+     * @return The number of matching entries.
+     */
+    uint64_t rangeCount(const Rectangle& range) const;
+
+    /**
+     * @brief Estimates the number of leaf entries intersecting a range, stopping the descent at
+     * a given level of the tree.
+     *
+     * Subtrees fully inside the range are counted exactly, as in rangeCount. A node at or below
+     * the given level that only partly overlaps the range is not descended into: it contributes
+     * its entry count times the fraction of its MBR covered by the range, which assumes its
+     * entries are spread uniformly, and adds its entry count to the upper bound only.
+     * Higher levels visit fewer nodes and give wider bounds.
      *
      * @param range The query range.
+     * @param level The level partially overlapping nodes are estimated at: 1 stops at the
+     *              leaves without reading their entries, 0 gives the exact count.
+     * @return The estimate and the lower and upper bounds of the count.
      */
-    void range(const Rectangle& range);
+    CountEstimate rangeCountEstimate(const Rectangle& range, int level) const;
 
     /**
      * @brief Performs a k-nearest neighbors (kNN) search on the R-tree.
      *
      * Finds the `k` nearest leaf entries (rectangles) to the given query point.
-     * This uses a priority queue for best-first search, prioritizing nodes/rectangles
-     * based on their distance to the query point.
+     * This uses a min-heap of nodes for best-first search, prioritizing nodes/rectangles
+     * based on their distance to the query point, and a bounded max-heap of candidates.
+     * Both heaps live in per-thread scratch buffers.
      *
      * @param p The query point.
      * @param k The number of nearest neighbors to find.
+     * @param results Vector the neighbours are appended to, in ascending distance order.
+     * @return The number of neighbours appended (k, or fewer if the tree is smaller).
+     */
+    int nearestN(const Point& p, int k, std::vector<Neighbor>& results) const;
+
+    /**
+     * @brief Runs a batch of range queries across the workers of a thread pool.
+     *
+     * Queries are handed out in chunks; each worker appends into its own result buffer
+     * with its own traversal scratch, and the buffers are merged in query order at the end.
+     *
+     * @param queries The query ranges.
+     * @param results Receives the ids of the matching entries of every query.
+     * @param pool The thread pool to run on.
+     */
+    void rangeBatch(const std::vector<Rectangle>& queries, BatchResults<int>& results, ThreadPool& pool) const;
+
+    /**
+     * @brief Runs a batch of k-nearest neighbors queries across the workers of a thread pool.
+     *
+     * @param queries The query points.
+     * @param k The number of nearest neighbors to find per query.
+     * @param results Receives the neighbours of every query, each in ascending distance order.
+     * @param pool The thread pool to run on.
+     */
+    void nearestBatch(const std::vector<Point>& queries, int k, BatchResults<Neighbor>& results, ThreadPool& pool) const;
+
+    /**
+     * @brief Reports the shape and memory use of the tree: height, node count, fill factor,
+     * MBR area, sibling overlap and dead space per level, and the bytes of the node headers
+     * and entry arrays.
+     *
+     * Areas are the volumes of the boxes in D dimensions. Walks every node once; the dead space
+     * takes time quadratic in the node capacity per node, times the capacity again per
+     * dimension above two.
+     *
+     * @return The statistics.
      */
-    void nearestN(const Point& p, int k);
+    [[nodiscard]] TreeStats stats() const;
+
+    /**
+     * @brief Returns the traversal counters collected by the queries of the calling thread
+     * since the last call, and resets them.
+     *
+     * Call it after every query for per-query counters, or after a batch for the aggregate.
+     * The batch APIs and the parallel joins add the counters of their workers to those of the
+     * calling thread before returning. All counters are zero unless built with RTREE_STATS.
+     *
+     * @return The counters.
+     */
+    static QueryStats takeStats();
+
+    /**
+     * @return the total number of leafs stored in the R-tree.
+     */
+    int getLeafsSize() const;
 };
 
+using RTreeBulkLoad = BasicRTree<2, float>;
+
 } // rtree
 
 #endif //RTREEBULKLOAD_H
@@ -0,0 +1,95 @@
+#include "IndexFile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rtree {
+
+    static_assert(sizeof(IndexFileHeader) <= INDEX_FILE_IMAGE_OFFSET, "IndexFileHeader must fit before the image");
+
+    void writeIndexFile(const std::string& path, IndexFileHeader header,
+                        const std::function<bool(std::FILE*)>& writeImage) {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            throw std::runtime_error("Unable to open index file " + path);
+        }
+
+        std::memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic));
+        header.version = INDEX_FILE_VERSION;
+        header.simdWidth = SIMD_WIDTH;
+        header.imageOffset = INDEX_FILE_IMAGE_OFFSET;
+
+        // The header is padded to the image offset
+        std::vector<char> page(INDEX_FILE_IMAGE_OFFSET, 0);
+        std::memcpy(page.data(), &header, sizeof(header));
+        bool ok = std::fwrite(page.data(), page.size(), 1, file) == 1 && writeImage(file);
+
+        if (std::fclose(file) != 0 || !ok) {
+            throw std::runtime_error("Unable to write index file " + path);
+        }
+    }
+
+    bool isIndexFile(const std::string& path) {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) return false;
+        char magic[sizeof(INDEX_FILE_MAGIC)];
+        const bool match = std::fread(magic, sizeof(magic), 1, file) == 1 &&
+                           std::memcmp(magic, INDEX_FILE_MAGIC, sizeof(magic)) == 0;
+        std::fclose(file);
+        return match;
+    }
+
+    MappedIndexFile::MappedIndexFile(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Unable to open index file " + path);
+        }
+        struct stat info{};
+        if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < INDEX_FILE_IMAGE_OFFSET) {
+            close(fd);
+            throw std::runtime_error("Invalid index file " + path);
+        }
+
+        m_length = static_cast<std::size_t>(info.st_size);
+        m_mapping = mmap(nullptr, m_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (m_mapping == MAP_FAILED) {
+            m_mapping = nullptr;
+            throw std::runtime_error("Unable to map index file " + path);
+        }
+
+        const IndexFileHeader& h = header();
+        if (std::memcmp(h.magic, INDEX_FILE_MAGIC, sizeof(h.magic)) != 0 ||
+            h.version != INDEX_FILE_VERSION ||
+            h.simdWidth != SIMD_WIDTH ||
+            h.capacity <= 0 || h.nodeCount <= 0 ||
+            h.rootNodeId < 0 || h.rootNodeId >= h.nodeCount ||
+            h.imageOffset != INDEX_FILE_IMAGE_OFFSET ||
+            h.imageBytes > m_length - h.imageOffset) {
+            munmap(m_mapping, m_length);
+            m_mapping = nullptr;
+            throw std::runtime_error("Invalid or incompatible index file " + path);
+        }
+    }
+
+    MappedIndexFile::~MappedIndexFile() {
+        if (m_mapping) {
+            munmap(m_mapping, m_length);
+        }
+    }
+
+    const IndexFileHeader& MappedIndexFile::header() const {
+        return *static_cast<const IndexFileHeader*>(m_mapping);
+    }
+
+    void* MappedIndexFile::image() const {
+        return static_cast<char*>(m_mapping) + header().imageOffset;
+    }
+
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#ifndef INDEXFILE_H
+#define INDEXFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+#include "../kernels/SimdKernels.h"
+
+namespace rtree {
+
+    /**
+     * Magic bytes at the start of a persisted index file.
+     */
+    constexpr char INDEX_FILE_MAGIC[8] = {'R', 'T', 'I', 'N', 'D', 'E', 'X', '1'};
+
+    /**
+     * Version of the persisted index file layout. Version 2 added the subtree counts of the nodes,
+     * version 3 the dimension count and coordinate type of the tree.
+     */
+    constexpr uint32_t INDEX_FILE_VERSION = 3;
+
+    /**
+     * Offset of the node arena image within an index file. Page aligned, so the mapped
+     * entry arrays keep the alignment the SIMD kernels rely on.
+     */
+    constexpr uint64_t INDEX_FILE_IMAGE_OFFSET = 4096;
+
+    /**
+     * @return The code of a coordinate type in an index file header: its kind (floating point,
+     * signed or unsigned integer) in the second byte and its size in the first.
+     */
+    template<typename T>
+    constexpr uint32_t coordinateTypeCode() {
+        return (std::is_floating_point_v<T> ? 0x100u : std::is_signed_v<T> ? 0x200u : 0x300u) | sizeof(T);
+    }
+
+    /**
+     * Header of a persisted index file. The arena image written by BasicNodeStore::writeImage
+     * starts at imageOffset. All values are stored in native byte order.
+     */
+    struct IndexFileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t nodeSize;
+        int32_t simdWidth;
+        int32_t capacity;
+        int32_t nodeCount;
+        int32_t rootNodeId;
+        int32_t treeHeight;
+        int32_t totalRectangles;
+        uint32_t dimensions;
+        uint32_t coordinateType;
+        uint64_t imageOffset;
+        uint64_t imageBytes;
+    };
+
+    /**
+     * @brief Writes an index file: the header followed by the arena image of the nodes.
+     *
+     * @param path Path of the output file, created or truncated.
+     * @param header The header of the tree; magic, version, SIMD width and image offset are filled in here.
+     * @param writeImage Writes the arena image of the nodes, header.imageBytes long, and returns false on failure.
+     * @throws std::runtime_error If the file cannot be written.
+     */
+    void writeIndexFile(const std::string& path, IndexFileHeader header,
+                        const std::function<bool(std::FILE*)>& writeImage);
+
+    /**
+     * @brief Checks whether a file starts with the index file magic.
+     *
+     * @param path Path of the file.
+     * @return True if the file is a persisted index.
+     */
+    bool isIndexFile(const std::string& path);
+
+    /**
+     * A memory-mapped index file.
+     *
+     * The file is mapped privately: pages are faulted in lazily as the tree is queried and
+     * any modification of the tree stays local to the process.
+     */
+    class MappedIndexFile {
+
+    public:
+
+        /**
+         * Constructor - maps the file and validates its header.
+         * @param path Path of the index file.
+         * @throws std::runtime_error If the file cannot be mapped or was written by an incompatible build.
+         */
+        explicit MappedIndexFile(const std::string& path);
+
+        /**
+         * Destructor - unmaps the file.
+         */
+        ~MappedIndexFile();
+
+        MappedIndexFile(const MappedIndexFile&) = delete;
+        MappedIndexFile& operator=(const MappedIndexFile&) = delete;
+
+        /**
+         * @return The header of the file.
+         */
+        [[nodiscard]] const IndexFileHeader& header() const;
+
+        /**
+         * @return The start of the arena image.
+         */
+        [[nodiscard]] void* image() const;
+
+    private:
+
+        void* m_mapping = nullptr;
+        std::size_t m_length = 0;
+    };
+
+}
+
+#endif // INDEXFILE_H
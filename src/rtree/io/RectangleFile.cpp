@@ -0,0 +1,101 @@
+#include "RectangleFile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rtree {
+
+    void writeRectangleFile(const std::string& path, const std::vector<Rectangle>& rectangles) {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            throw std::runtime_error("Unable to open rectangle file " + path);
+        }
+
+        RectangleFileHeader header{};
+        std::memcpy(header.magic, RECTANGLE_FILE_MAGIC, sizeof(header.magic));
+        header.version = RECTANGLE_FILE_VERSION;
+        header.recordSize = sizeof(RectangleRecord);
+        header.count = rectangles.size();
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+        // Write the records through a fixed staging buffer.
+        std::vector<RectangleRecord> buffer;
+        buffer.reserve(1 << 16);
+        for (std::size_t i = 0; ok && i < rectangles.size(); i++) {
+            const Rectangle& r = rectangles[i];
+            buffer.push_back({r.min[0], r.min[1], r.max[0], r.max[1], r.id});
+            if (buffer.size() == buffer.capacity() || i + 1 == rectangles.size()) {
+                ok = std::fwrite(buffer.data(), sizeof(RectangleRecord), buffer.size(), file) == buffer.size();
+                buffer.clear();
+            }
+        }
+
+        if (std::fclose(file) != 0 || !ok) {
+            throw std::runtime_error("Unable to write rectangle file " + path);
+        }
+    }
+
+    bool isRectangleFile(const std::string& path) {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) return false;
+        char magic[sizeof(RECTANGLE_FILE_MAGIC)];
+        const bool match = std::fread(magic, sizeof(magic), 1, file) == 1 &&
+                           std::memcmp(magic, RECTANGLE_FILE_MAGIC, sizeof(magic)) == 0;
+        std::fclose(file);
+        return match;
+    }
+
+    MappedRectangleFile::MappedRectangleFile(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Unable to open rectangle file " + path);
+        }
+        struct stat info{};
+        if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(RectangleFileHeader)) {
+            close(fd);
+            throw std::runtime_error("Invalid rectangle file " + path);
+        }
+
+        m_length = static_cast<std::size_t>(info.st_size);
+        m_mapping = mmap(nullptr, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (m_mapping == MAP_FAILED) {
+            m_mapping = nullptr;
+            throw std::runtime_error("Unable to map rectangle file " + path);
+        }
+
+        const auto* header = static_cast<const RectangleFileHeader*>(m_mapping);
+        if (std::memcmp(header->magic, RECTANGLE_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != RECTANGLE_FILE_VERSION ||
+            header->recordSize != sizeof(RectangleRecord) ||
+            header->count > (m_length - sizeof(RectangleFileHeader)) / sizeof(RectangleRecord)) {
+            munmap(m_mapping, m_length);
+            m_mapping = nullptr;
+            throw std::runtime_error("Invalid rectangle file " + path);
+        }
+
+        m_size = header->count;
+        m_records = reinterpret_cast<const RectangleRecord*>(static_cast<const char*>(m_mapping) + sizeof(RectangleFileHeader));
+        madvise(m_mapping, m_length, MADV_SEQUENTIAL);
+    }
+
+    MappedRectangleFile::~MappedRectangleFile() {
+        if (m_mapping) {
+            munmap(m_mapping, m_length);
+        }
+    }
+
+    const RectangleRecord* MappedRectangleFile::records() const {
+        return m_records;
+    }
+
+    std::size_t MappedRectangleFile::size() const {
+        return m_size;
+    }
+
+}
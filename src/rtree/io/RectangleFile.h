@@ -0,0 +1,112 @@
+#pragma once
+
+#ifndef RECTANGLEFILE_H
+#define RECTANGLEFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../structures/Rectangle.h"
+
+namespace rtree {
+
+    /**
+     * Magic bytes at the start of a binary rectangle file.
+     */
+    constexpr char RECTANGLE_FILE_MAGIC[8] = {'R', 'T', 'R', 'E', 'C', 'T', '0', '1'};
+
+    /**
+     * Version of the binary rectangle file layout.
+     */
+    constexpr uint32_t RECTANGLE_FILE_VERSION = 1;
+
+    /**
+     * Header of a binary rectangle file, followed by count packed records.
+     * All values are stored in native byte order.
+     */
+    struct RectangleFileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t count;
+    };
+
+    /**
+     * One rectangle of a binary rectangle file.
+     */
+    struct RectangleRecord {
+        float minX;
+        float minY;
+        float maxX;
+        float maxY;
+        int32_t id;
+    };
+
+    static_assert(sizeof(RectangleFileHeader) == 24, "RectangleFileHeader must be packed");
+    static_assert(sizeof(RectangleRecord) == 20, "RectangleRecord must be packed");
+
+    /**
+     * @brief Writes rectangles to a binary rectangle file.
+     *
+     * @param path Path of the output file, created or truncated.
+     * @param rectangles The rectangles to write.
+     * @throws std::runtime_error If the file cannot be written.
+     */
+    void writeRectangleFile(const std::string& path, const std::vector<Rectangle>& rectangles);
+
+    /**
+     * @brief Checks whether a file starts with the binary rectangle file magic.
+     *
+     * @param path Path of the file.
+     * @return True if the file is a binary rectangle file.
+     */
+    bool isRectangleFile(const std::string& path);
+
+    /**
+     * A read-only, memory-mapped binary rectangle file.
+     *
+     * The records are used in place: opening the file validates the header and maps it,
+     * without reading or parsing the records.
+     */
+    class MappedRectangleFile {
+
+    public:
+
+        /**
+         * Constructor - maps the file.
+         * @param path Path of the binary rectangle file.
+         * @throws std::runtime_error If the file cannot be mapped or is not a valid rectangle file.
+         */
+        explicit MappedRectangleFile(const std::string& path);
+
+        /**
+         * Destructor - unmaps the file.
+         */
+        ~MappedRectangleFile();
+
+        MappedRectangleFile(const MappedRectangleFile&) = delete;
+        MappedRectangleFile& operator=(const MappedRectangleFile&) = delete;
+
+        /**
+         * @return Pointer to the first record.
+         */
+        [[nodiscard]] const RectangleRecord* records() const;
+
+        /**
+         * @return The number of records.
+         */
+        [[nodiscard]] std::size_t size() const;
+
+    private:
+
+        void* m_mapping = nullptr;
+        std::size_t m_length = 0;
+        const RectangleRecord* m_records = nullptr;
+        std::size_t m_size = 0;
+    };
+
+}
+
+#endif // RECTANGLEFILE_H
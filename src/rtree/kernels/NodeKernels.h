@@ -0,0 +1,233 @@
+#pragma once
+
+#ifndef NODEKERNELS_H
+#define NODEKERNELS_H
+
+#include <cstdint>
+
+#include "../structures/Node.h"
+#include "../structures/Rectangle.h"
+#include "SimdKernels.h"
+
+namespace rtree {
+
+    /**
+     * The per-node kernels of BasicRTree<D, T>: range filters, distance filters and the plane
+     * sweep of the join, over the structure-of-arrays entries of a node sorted by the minimum
+     * on the first axis.
+     *
+     * The general template works for any dimension count and coordinate type. The per-axis
+     * tests are combined without branches and the axis loop has a compile-time bound, so it
+     * unrolls. With a slot count fixed at compile time, the nodes of a fixed-capacity tree, the
+     * range kernels also bound the entry loop by Slots, so the compiler knows its trip count;
+     * the slots past count are never read, as in the run-time case. The two-dimensional float
+     * kernels are specialised below to the AVX kernels of SimdKernels.h. Output buffers need
+     * room for count rounded up to SIMD_WIDTH values, which the kernels may store into past
+     * the hits.
+     *
+     * @tparam Slots Number of entry slots of every node, or 0 if only known at run time.
+     */
+    template<int D, typename T, int Slots = 0>
+    struct NodeKernels {
+
+        using Entries = BasicNodeEntries<D, T>;
+        using Distance = DistanceType<T>;
+
+        /**
+         * @return True if entry i intersects the query box.
+         */
+        static bool intersects(const Entries& e, int i, const T* queryMin, const T* queryMax) {
+            bool hit = true;
+            for (int d = 0; d < D; d++) {
+                hit &= (e.max[d][i] >= queryMin[d]) & (e.min[d][i] <= queryMax[d]);
+            }
+            return hit;
+        }
+
+        /**
+         * @brief Collects the ids of the entries intersecting a query box, stopping at the first
+         * entry that starts past the query on the first axis.
+         *
+         * @param e The entries.
+         * @param count Number of valid entries.
+         * @param queryMin Minimum corner of the query box.
+         * @param queryMax Maximum corner of the query box.
+         * @param out Receives the ids of the intersecting entries.
+         * @return The number of ids written to out.
+         */
+        static uint32_t sweepRange(const Entries& e, int count, const T* queryMin, const T* queryMax, int* out) {
+            uint32_t hits = 0;
+            for (int i = 0; (Slots == 0 || i < Slots) && i < count && e.min[0][i] <= queryMax[0]; i++) {
+                out[hits] = e.ids[i];
+                hits += intersects(e, i, queryMin, queryMax);
+            }
+            return hits;
+        }
+
+        /**
+         * @brief Same sweep as sweepRange, emitting the slot of every intersecting entry instead of its id.
+         */
+        static uint32_t filterRange(const Entries& e, int count, const T* queryMin, const T* queryMax, int* slots) {
+            uint32_t hits = 0;
+            for (int i = 0; (Slots == 0 || i < Slots) && i < count && e.min[0][i] <= queryMax[0]; i++) {
+                slots[hits] = i;
+                hits += intersects(e, i, queryMin, queryMax);
+            }
+            return hits;
+        }
+
+        /**
+         * @brief Same sweep as sweepRange, only counting the intersecting entries.
+         */
+        static uint32_t countRange(const Entries& e, int count, const T* queryMin, const T* queryMax) {
+            uint32_t hits = 0;
+            for (int i = 0; (Slots == 0 || i < Slots) && i < count && e.min[0][i] <= queryMax[0]; i++) {
+                hits += intersects(e, i, queryMin, queryMax);
+            }
+            return hits;
+        }
+
+        /**
+         * @brief Collects the entries nearer to a point than a bound, with their squared distances.
+         *
+         * @param e The entries.
+         * @param count Number of valid entries.
+         * @param point The query point, in the type of the distances so that a centre between
+         *              integer coordinates stays exact.
+         * @param bound Exclusive upper bound on the squared distance; infinity keeps every entry.
+         * @param distances Receives the squared distances of the kept entries.
+         * @param slots Receives the positions of the kept entries.
+         * @return The number of entries kept.
+         */
+        static uint32_t filterDistance(const Entries& e, int count, const Distance* point, Distance bound,
+                                       Distance* distances, int* slots) {
+            uint32_t hits = 0;
+            for (int i = 0; i < count; i++) {
+                Distance total = 0;
+                for (int d = 0; d < D; d++) {
+                    const Distance below = static_cast<Distance>(e.min[d][i]) - point[d];
+                    const Distance above = static_cast<Distance>(point[d]) - e.max[d][i];
+                    const Distance gap = below > 0 ? below : (above > 0 ? above : 0);
+                    total += gap * gap;
+                }
+                distances[hits] = total;
+                slots[hits] = i;
+                hits += total < bound;
+            }
+            return hits;
+        }
+
+        /**
+         * @brief Box version of filterDistance: the squared minimum distance between a query box
+         * and every entry.
+         */
+        static uint32_t filterDistance(const Entries& e, int count, const Distance* queryMin, const Distance* queryMax,
+                                       Distance bound, Distance* distances, int* slots) {
+            uint32_t hits = 0;
+            for (int i = 0; i < count; i++) {
+                Distance total = 0;
+                for (int d = 0; d < D; d++) {
+                    const Distance below = static_cast<Distance>(e.min[d][i]) - queryMax[d];
+                    const Distance above = static_cast<Distance>(queryMin[d]) - e.max[d][i];
+                    const Distance gap = below > 0 ? below : (above > 0 ? above : 0);
+                    total += gap * gap;
+                }
+                distances[hits] = total;
+                slots[hits] = i;
+                hits += total < bound;
+            }
+            return hits;
+        }
+
+        /**
+         * @brief Joins two runs of entries sorted by their minimum on the first axis with a
+         * forward plane sweep: the run whose next entry starts first is advanced and that entry
+         * is tested against the entries of the other run that start before it ends, so every
+         * intersecting pair is found exactly once.
+         *
+         * @param a The first run.
+         * @param countA Number of entries in the first run.
+         * @param b The second run.
+         * @param countB Number of entries in the second run.
+         * @param outA Receives the first-run id of every intersecting pair.
+         * @param outB Receives the second-run id of every intersecting pair.
+         * @return The number of pairs written.
+         */
+        static uint32_t sweepJoin(const Entries& a, int countA, const Entries& b, int countB, int* outA, int* outB) {
+            uint32_t pairs = 0;
+            int i = 0;
+            int j = 0;
+            while (i < countA && j < countB) {
+                if (a.min[0][i] <= b.min[0][j]) {
+                    for (int k = j; k < countB && b.min[0][k] <= a.max[0][i]; k++) {
+                        bool hit = true;
+                        for (int d = 0; d < D; d++) {
+                            hit &= (a.max[d][i] >= b.min[d][k]) & (a.min[d][i] <= b.max[d][k]);
+                        }
+                        outA[pairs] = a.ids[i];
+                        outB[pairs] = b.ids[k];
+                        pairs += hit;
+                    }
+                    i++;
+                } else {
+                    for (int k = i; k < countA && a.min[0][k] <= b.max[0][j]; k++) {
+                        bool hit = true;
+                        for (int d = 0; d < D; d++) {
+                            hit &= (a.max[d][k] >= b.min[d][j]) & (a.min[d][k] <= b.max[d][j]);
+                        }
+                        outA[pairs] = a.ids[k];
+                        outB[pairs] = b.ids[j];
+                        pairs += hit;
+                    }
+                    j++;
+                }
+            }
+            return pairs;
+        }
+    };
+
+    /**
+     * The two-dimensional float kernels: the AVX kernels of SimdKernels.h, which already
+     * process whole vectors and mask the lanes past count, for any slot count.
+     */
+    template<int Slots>
+    struct NodeKernels<2, float, Slots> {
+
+        using Entries = BasicNodeEntries<2, float>;
+
+        static uint32_t sweepRange(const Entries& e, int count, const float* queryMin, const float* queryMax, int* out) {
+            return rtree::sweepRange(e.min[0], e.min[1], e.max[0], e.max[1], e.ids, count,
+                                     queryMin[0], queryMin[1], queryMax[0], queryMax[1], out);
+        }
+
+        static uint32_t filterRange(const Entries& e, int count, const float* queryMin, const float* queryMax, int* slots) {
+            return rtree::filterRange(e.min[0], e.min[1], e.max[0], e.max[1], count,
+                                      queryMin[0], queryMin[1], queryMax[0], queryMax[1], slots);
+        }
+
+        static uint32_t countRange(const Entries& e, int count, const float* queryMin, const float* queryMax) {
+            return rtree::countRange(e.min[0], e.min[1], e.max[0], e.max[1], count,
+                                     queryMin[0], queryMin[1], queryMax[0], queryMax[1]);
+        }
+
+        static uint32_t filterDistance(const Entries& e, int count, const float* point, float bound,
+                                       float* distances, int* slots) {
+            return rtree::filterDistance(e.min[0], e.min[1], e.max[0], e.max[1], count,
+                                         point[0], point[1], bound, distances, slots);
+        }
+
+        static uint32_t filterDistance(const Entries& e, int count, const float* queryMin, const float* queryMax,
+                                       float bound, float* distances, int* slots) {
+            return rtree::filterDistance(e.min[0], e.min[1], e.max[0], e.max[1], count,
+                                         queryMin[0], queryMin[1], queryMax[0], queryMax[1], bound, distances, slots);
+        }
+
+        static uint32_t sweepJoin(const Entries& a, int countA, const Entries& b, int countB, int* outA, int* outB) {
+            return rtree::sweepJoin(a.min[0], a.min[1], a.max[0], a.max[1], a.ids, countA,
+                                    b.min[0], b.min[1], b.max[0], b.max[1], b.ids, countB, outA, outB);
+        }
+    };
+
+}
+
+#endif // NODEKERNELS_H
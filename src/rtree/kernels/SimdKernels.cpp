@@ -0,0 +1,402 @@
+#include "SimdKernels.h"
+
+#include <algorithm>
+#include <array>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+namespace rtree {
+
+#ifdef __AVX__
+    namespace {
+
+        using ShuffleTable = std::array<std::array<uint8_t, 16>, 16>;
+
+        /**
+         * For every 4-bit lane mask, the byte shuffle that moves the selected 32-bit lanes
+         * of a 128-bit vector to its front (AVX has no native compress instruction).
+         */
+        constexpr ShuffleTable makeCompressTable() {
+            ShuffleTable table{};
+            for (int mask = 0; mask < 16; mask++) {
+                int out = 0;
+                for (int lane = 0; lane < 4; lane++) {
+                    if (mask & (1 << lane)) {
+                        for (int b = 0; b < 4; b++) table[mask][out * 4 + b] = lane * 4 + b;
+                        out++;
+                    }
+                }
+                for (; out < 4; out++) {
+                    for (int b = 0; b < 4; b++) table[mask][out * 4 + b] = 0x80;
+                }
+            }
+            return table;
+        }
+
+        alignas(16) constexpr ShuffleTable COMPRESS_TABLE = makeCompressTable();
+
+        /**
+         * Append the 32-bit lanes of (lo, hi) selected by mask (8 bits) to out.
+         * @return The number of values appended.
+         */
+        inline uint32_t compress(__m128i lo, __m128i hi, int mask, int* out) {
+            const int maskLo = mask & 0xF;
+            const int maskHi = mask >> 4;
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                _mm_shuffle_epi8(lo, _mm_load_si128(reinterpret_cast<const __m128i*>(COMPRESS_TABLE[maskLo].data()))));
+            const int nLo = __builtin_popcount(maskLo);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + nLo),
+                _mm_shuffle_epi8(hi, _mm_load_si128(reinterpret_cast<const __m128i*>(COMPRESS_TABLE[maskHi].data()))));
+            return nLo + __builtin_popcount(maskHi);
+        }
+
+        /**
+         * @return The movemask bits of the lanes of a block that hold entries, given the number
+         * of entries left from its start. The padding lanes beyond the run are cleared, as an
+         * unbounded query window or distance bound matches their empty rectangles too.
+         */
+        inline int validLanes(int remaining) {
+            return remaining >= SIMD_WIDTH ? 0xFF : (1 << remaining) - 1;
+        }
+    }
+#endif
+
+    namespace {
+
+        /**
+         * What the shared sweep produces for the intersecting entries.
+         */
+        enum class SweepOutput { Ids, Slots, Count };
+
+        /**
+         * Shared sweep over minX-sorted entries. Emits the entry ids, the slot positions of the
+         * intersecting entries, or only counts them.
+         */
+        template<SweepOutput Output>
+        inline uint32_t sweep(const float* minX, const float* minY, const float* maxX, const float* maxY,
+                              const int* ids, int count,
+                              float rangeMinX, float rangeMinY, float rangeMaxX, float rangeMaxY,
+                              int* out) {
+            uint32_t size = 0;
+#ifdef __AVX__
+            const __m256 qMinX = _mm256_set1_ps(rangeMinX);
+            const __m256 qMinY = _mm256_set1_ps(rangeMinY);
+            const __m256 qMaxX = _mm256_set1_ps(rangeMaxX);
+            const __m256 qMaxY = _mm256_set1_ps(rangeMaxY);
+
+            for (int i = 0; i < count; i += SIMD_WIDTH) {
+                const __m256 lx = _mm256_load_ps(minX + i);
+                const __m256 startsBefore = _mm256_cmp_ps(lx, qMaxX, _CMP_LE_OQ);
+
+                __m256 hit = _mm256_and_ps(startsBefore, _mm256_cmp_ps(_mm256_load_ps(maxX + i), qMinX, _CMP_GE_OQ));
+                hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_load_ps(minY + i), qMaxY, _CMP_LE_OQ));
+                hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_load_ps(maxY + i), qMinY, _CMP_GE_OQ));
+
+                const int valid = validLanes(count - i);
+                const int mask = _mm256_movemask_ps(hit) & valid;
+                if (mask) {
+                    if constexpr (Output == SweepOutput::Count) {
+                        size += __builtin_popcount(mask);
+                    } else if constexpr (Output == SweepOutput::Ids) {
+                        size += compress(_mm_load_si128(reinterpret_cast<const __m128i*>(ids + i)),
+                                         _mm_load_si128(reinterpret_cast<const __m128i*>(ids + i + 4)),
+                                         mask, out + size);
+                    } else {
+                        const __m128i base = _mm_set1_epi32(i);
+                        size += compress(_mm_add_epi32(base, _mm_setr_epi32(0, 1, 2, 3)),
+                                         _mm_add_epi32(base, _mm_setr_epi32(4, 5, 6, 7)),
+                                         mask, out + size);
+                    }
+                }
+
+                // Entries are sorted by minX: once a lane starts past the window, so do all later ones.
+                if ((_mm256_movemask_ps(startsBefore) & valid) != valid) break;
+            }
+#else
+            for (int i = 0; i < count && minX[i] <= rangeMaxX; i++) {
+                if (maxX[i] >= rangeMinX && minY[i] <= rangeMaxY && maxY[i] >= rangeMinY) {
+                    if constexpr (Output == SweepOutput::Count) {
+                        size++;
+                    } else {
+                        out[size++] = Output == SweepOutput::Ids ? ids[i] : i;
+                    }
+                }
+            }
+#endif
+            return size;
+        }
+    }
+
+    uint32_t sweepRange(const float* minX, const float* minY, const float* maxX, const float* maxY,
+                        const int* ids, int count,
+                        float rangeMinX, float rangeMinY, float rangeMaxX, float rangeMaxY,
+                        int* out) {
+        return sweep<SweepOutput::Ids>(minX, minY, maxX, maxY, ids, count,
+                                       rangeMinX, rangeMinY, rangeMaxX, rangeMaxY, out);
+    }
+
+    uint32_t filterRange(const float* minX, const float* minY, const float* maxX, const float* maxY,
+                         int count,
+                         float rangeMinX, float rangeMinY, float rangeMaxX, float rangeMaxY,
+                         int* slots) {
+        return sweep<SweepOutput::Slots>(minX, minY, maxX, maxY, nullptr, count,
+                                         rangeMinX, rangeMinY, rangeMaxX, rangeMaxY, slots);
+    }
+
+    uint32_t countRange(const float* minX, const float* minY, const float* maxX, const float* maxY,
+                        int count,
+                        float rangeMinX, float rangeMinY, float rangeMaxX, float rangeMaxY) {
+        return sweep<SweepOutput::Count>(minX, minY, maxX, maxY, nullptr, count,
+                                         rangeMinX, rangeMinY, rangeMaxX, rangeMaxY, nullptr);
+    }
+
+    uint32_t filterDistance(const float* minX, const float* minY, const float* maxX, const float* maxY,
+                            int count, float qMinX, float qMinY, float qMaxX, float qMaxY, float bound,
+                            float* distances, int* slots) {
+        uint32_t size = 0;
+#ifdef __AVX__
+        const __m256 lowX = _mm256_set1_ps(qMinX);
+        const __m256 lowY = _mm256_set1_ps(qMinY);
+        const __m256 highX = _mm256_set1_ps(qMaxX);
+        const __m256 highY = _mm256_set1_ps(qMaxY);
+        const __m256 limit = _mm256_set1_ps(bound);
+        const __m256 zero = _mm256_setzero_ps();
+
+        for (int i = 0; i < count; i += SIMD_WIDTH) {
+            // At most one of the two gaps is positive along each axis for non-empty boxes.
+            const __m256 dx = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_load_ps(minX + i), highX),
+                                                          _mm256_sub_ps(lowX, _mm256_load_ps(maxX + i))), zero);
+            const __m256 dy = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_load_ps(minY + i), highY),
+                                                          _mm256_sub_ps(lowY, _mm256_load_ps(maxY + i))), zero);
+            const __m256 d = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+
+            const int mask = _mm256_movemask_ps(_mm256_cmp_ps(d, limit, _CMP_LT_OQ)) & validLanes(count - i);
+            if (mask) {
+                const __m256i bits = _mm256_castps_si256(d);
+                compress(_mm256_castsi256_si128(bits), _mm256_extractf128_si256(bits, 1), mask,
+                         reinterpret_cast<int*>(distances + size));
+                const __m128i base = _mm_set1_epi32(i);
+                size += compress(_mm_add_epi32(base, _mm_setr_epi32(0, 1, 2, 3)),
+                                 _mm_add_epi32(base, _mm_setr_epi32(4, 5, 6, 7)),
+                                 mask, slots + size);
+            }
+        }
+#else
+        for (int i = 0; i < count; i++) {
+            const float dx = std::max(std::max(minX[i] - qMaxX, qMinX - maxX[i]), 0.0f);
+            const float dy = std::max(std::max(minY[i] - qMaxY, qMinY - maxY[i]), 0.0f);
+            const float d = dx * dx + dy * dy;
+            if (d < bound) {
+                distances[size] = d;
+                slots[size++] = i;
+            }
+        }
+#endif
+        return size;
+    }
+
+    uint32_t filterDistance(const float* minX, const float* minY, const float* maxX, const float* maxY,
+                            int count, float x, float y, float bound,
+                            float* distances, int* slots) {
+        return filterDistance(minX, minY, maxX, maxY, count, x, y, x, y, bound, distances, slots);
+    }
+
+    namespace {
+
+        /**
+         * One step of the plane sweep: tests the pivot entry against the entries of the other
+         * run from position from onwards, until they start past the pivot's maxX. The other
+         * entries start no earlier than the pivot, so the X overlap reduces to that bound.
+         */
+        inline uint32_t sweepPivot(float pMinY, float pMaxX, float pMaxY, int pivotId,
+                                   const float* minX, const float* minY, const float* maxY, const int* ids,
+                                   int from, int count, int* pivotOut, int* otherOut) {
+            uint32_t size = 0;
+#ifdef __AVX__
+            const __m256 qMaxX = _mm256_set1_ps(pMaxX);
+            const __m256 qMinY = _mm256_set1_ps(pMinY);
+            const __m256 qMaxY = _mm256_set1_ps(pMaxY);
+            const __m256i pivot = _mm256_set1_epi32(pivotId);
+
+            for (int i = from; i < count; i += SIMD_WIDTH) {
+                const __m256 startsBefore = _mm256_cmp_ps(_mm256_loadu_ps(minX + i), qMaxX, _CMP_LE_OQ);
+
+                __m256 hit = _mm256_and_ps(startsBefore, _mm256_cmp_ps(_mm256_loadu_ps(minY + i), qMaxY, _CMP_LE_OQ));
+                hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_loadu_ps(maxY + i), qMinY, _CMP_GE_OQ));
+
+                const int valid = validLanes(count - i);
+                const int mask = _mm256_movemask_ps(hit) & valid;
+                if (mask) {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pivotOut + size), pivot);
+                    size += compress(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ids + i)),
+                                     _mm_loadu_si128(reinterpret_cast<const __m128i*>(ids + i + 4)),
+                                     mask, otherOut + size);
+                }
+
+                if ((_mm256_movemask_ps(startsBefore) & valid) != valid) break;
+            }
+#else
+            for (int i = from; i < count && minX[i] <= pMaxX; i++) {
+                if (minY[i] <= pMaxY && maxY[i] >= pMinY) {
+                    pivotOut[size] = pivotId;
+                    otherOut[size] = ids[i];
+                    size++;
+                }
+            }
+#endif
+            return size;
+        }
+    }
+
+    uint32_t sweepJoin(const float* aMinX, const float* aMinY, const float* aMaxX, const float* aMaxY,
+                       const int* aIds, int countA,
+                       const float* bMinX, const float* bMinY, const float* bMaxX, const float* bMaxY,
+                       const int* bIds, int countB,
+                       int* outA, int* outB) {
+        uint32_t size = 0;
+        int i = 0;
+        int j = 0;
+        while (i < countA && j < countB) {
+            if (aMinX[i] <= bMinX[j]) {
+                size += sweepPivot(aMinY[i], aMaxX[i], aMaxY[i], aIds[i],
+                                   bMinX, bMinY, bMaxY, bIds, j, countB, outA + size, outB + size);
+                i++;
+            } else {
+                size += sweepPivot(bMinY[j], bMaxX[j], bMaxY[j], bIds[j],
+                                   aMinX, aMinY, aMaxY, aIds, i, countA, outB + size, outA + size);
+                j++;
+            }
+        }
+        return size;
+    }
+
+    namespace {
+
+#ifdef __AVX__
+        /**
+         * 128-bit integer operations on quantised codes. SSE has no unsigned comparisons, so
+         * a <= b is tested as min(a, b) == a.
+         */
+        template<typename Code>
+        struct CodeVector;
+
+        template<>
+        struct CodeVector<uint8_t> {
+            static constexpr int LANES = 16;
+
+            static __m128i set(uint8_t value) {
+                return _mm_set1_epi8(static_cast<char>(value));
+            }
+
+            /** @return All bits of the lanes where a <= b set. */
+            static __m128i lessEqual(__m128i a, __m128i b) {
+                return _mm_cmpeq_epi8(_mm_min_epu8(a, b), a);
+            }
+
+            /** @return One bit per lane of a comparison result. */
+            static unsigned bits(__m128i lanes) {
+                return _mm_movemask_epi8(lanes);
+            }
+        };
+
+        template<>
+        struct CodeVector<uint16_t> {
+            static constexpr int LANES = 8;
+
+            static __m128i set(uint16_t value) {
+                return _mm_set1_epi16(static_cast<short>(value));
+            }
+
+            /** @return All bits of the lanes where a <= b set. */
+            static __m128i lessEqual(__m128i a, __m128i b) {
+                return _mm_cmpeq_epi16(_mm_min_epu16(a, b), a);
+            }
+
+            /** @return One bit per lane of a comparison result. */
+            static unsigned bits(__m128i lanes) {
+                return _mm_movemask_epi8(_mm_packs_epi16(lanes, _mm_setzero_si128()));
+            }
+        };
+
+        /**
+         * Append base plus the position of every set bit of mask to out.
+         */
+        inline void emitSlots(unsigned mask, int base, int* out, uint32_t& size) {
+            while (mask) {
+                out[size++] = base + __builtin_ctz(mask);
+                mask &= mask - 1;
+            }
+        }
+#endif
+
+        template<typename Code>
+        CodeHits filterQuantized(const Code* minX, const Code* minY, const Code* maxX, const Code* maxY,
+                                 int count, Code qMinX, Code qMinY, Code qMaxX, Code qMaxY,
+                                 int* boundary, int* inside) {
+            CodeHits hits{0, 0};
+#ifdef __AVX__
+            using V = CodeVector<Code>;
+            const __m128i vMinX = V::set(qMinX);
+            const __m128i vMinY = V::set(qMinY);
+            const __m128i vMaxX = V::set(qMaxX);
+            const __m128i vMaxY = V::set(qMaxY);
+
+            for (int i = 0; i < count; i += V::LANES) {
+                const __m128i lx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(minX + i));
+                const __m128i ly = _mm_loadu_si128(reinterpret_cast<const __m128i*>(minY + i));
+                const __m128i hx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(maxX + i));
+                const __m128i hy = _mm_loadu_si128(reinterpret_cast<const __m128i*>(maxY + i));
+                const unsigned valid = count - i >= V::LANES ? (1u << V::LANES) - 1 : (1u << (count - i)) - 1;
+
+                const __m128i startsBeforeLanes = V::lessEqual(lx, vMaxX);
+                const __m128i hitLanes = _mm_and_si128(_mm_and_si128(startsBeforeLanes, V::lessEqual(vMinX, hx)),
+                                                       _mm_and_si128(V::lessEqual(ly, vMaxY), V::lessEqual(vMinY, hy)));
+                const __m128i touchLanes = _mm_or_si128(_mm_or_si128(V::lessEqual(lx, vMinX), V::lessEqual(ly, vMinY)),
+                                                        _mm_or_si128(V::lessEqual(vMaxX, hx), V::lessEqual(vMaxY, hy)));
+
+                const unsigned startsBefore = V::bits(startsBeforeLanes) & valid;
+                const unsigned hit = V::bits(hitLanes) & valid;
+                const unsigned in = hit & ~V::bits(touchLanes);
+
+                emitSlots(hit & ~in, i, boundary, hits.boundary);
+                if (inside) {
+                    emitSlots(in, i, inside, hits.inside);
+                } else {
+                    hits.inside += __builtin_popcount(in);
+                }
+
+                // Entries are sorted by minX: once a lane starts past the window, so do all later ones.
+                if (startsBefore != valid) break;
+            }
+#else
+            for (int i = 0; i < count && minX[i] <= qMaxX; i++) {
+                if (maxX[i] < qMinX || minY[i] > qMaxY || maxY[i] < qMinY) continue;
+                if (minX[i] > qMinX && minY[i] > qMinY && maxX[i] < qMaxX && maxY[i] < qMaxY) {
+                    if (inside) inside[hits.inside] = i;
+                    hits.inside++;
+                } else {
+                    boundary[hits.boundary++] = i;
+                }
+            }
+#endif
+            return hits;
+        }
+    }
+
+    CodeHits filterCodes(const uint8_t* minX, const uint8_t* minY, const uint8_t* maxX, const uint8_t* maxY,
+                         int count, uint8_t qMinX, uint8_t qMinY, uint8_t qMaxX, uint8_t qMaxY,
+                         int* boundary, int* inside) {
+        return filterQuantized(minX, minY, maxX, maxY, count, qMinX, qMinY, qMaxX, qMaxY, boundary, inside);
+    }
+
+    CodeHits filterCodes(const uint16_t* minX, const uint16_t* minY, const uint16_t* maxX, const uint16_t* maxY,
+                         int count, uint16_t qMinX, uint16_t qMinY, uint16_t qMaxX, uint16_t qMaxY,
+                         int* boundary, int* inside) {
+        return filterQuantized(minX, minY, maxX, maxY, count, qMinX, qMinY, qMaxX, qMaxY, boundary, inside);
+    }
+
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#ifndef SIMDKERNELS_H
+#define SIMDKERNELS_H
+
+#include <cstdint>
+
+namespace rtree {
+
+    /**
+     * Number of single-precision lanes processed per instruction by the AVX kernels.
+     * Per-entry node arrays are padded to a multiple of this value.
+     */
+    constexpr int SIMD_WIDTH = 8;
+
+    /**
+     * Number of codes filterCodes may read past the last entry of a run. Arrays of quantised
+     * boxes are padded by this many codes.
+     */
+    constexpr int CODE_PADDING = 16;
+
+    /**
+     * Result of filterCodes: the number of candidates on the boundary of the query and the
+     * number strictly inside it.
+     */
+    struct CodeHits {
+        uint32_t boundary;
+        uint32_t inside;
+    };
+
+    /**
+     * @brief Sweeps the entries of a leaf node, collecting the ids of those intersecting a query window.
+     *
+     * The entries are given as structure-of-arrays coordinates sorted by minX and padded to a
+     * multiple of SIMD_WIDTH with empty rectangles. Each block of SIMD_WIDTH entries is tested
+     * with a single set of vector comparisons, the lanes past count are masked off and the ids
+     * of the matching lanes are compressed into the output buffer. The sweep stops after the first block that reaches past rangeMaxX.
+     *
+     * The output buffer must have room for count rounded up to SIMD_WIDTH ids, since the
+     * compress step stores whole vectors.
+     *
+     * @param minX Minimum X coordinates of the entries (32-byte aligned).
+     * @param minY Minimum Y coordinates of the entries (32-byte aligned).
+     * @param maxX Maximum X coordinates of the entries (32-byte aligned).
+     * @param maxY Maximum Y coordinates of the entries (32-byte aligned).
+     * @param ids IDs of the entries (32-byte aligned).
+     * @param count Number of valid entries.
+     * @param rangeMinX Minimum X coordinate of the query window.
+     * @param rangeMinY Minimum Y coordinate of the query window.
+     * @param rangeMaxX Maximum X coordinate of the query window.
+     * @param rangeMaxY Maximum Y coordinate of the query window.
+     * @param out Output buffer receiving the ids of intersecting entries.
+     * @return The number of ids written to out.
+     */
+    uint32_t sweepRange(const float* minX, const float* minY, const float* maxX, const float* maxY,
+                        const int* ids, int count,
+                        float rangeMinX, float rangeMinY, float rangeMaxX, float rangeMaxY,
+                        int* out);
+
+    /**
+     * @brief Filters the entries of a node against a query window, returning the positions of the hits.
+     *
+     * Same sweep as sweepRange, but emits the slot index of every intersecting entry instead of
+     * its id. Used on internal nodes, where only the surviving children are dereferenced.
+     * The same output buffer requirements apply.
+     *
+     * @param minX Minimum X coordinates of the entries (32-byte aligned).
+     * @param minY Minimum Y coordinates of the entries (32-byte aligned).
+     * @param maxX Maximum X coordinates of the entries (32-byte aligned).
+     * @param maxY Maximum Y coordinates of the entries (32-byte aligned).
+     * @param count Number of valid entries.
+     * @param rangeMinX Minimum X coordinate of the query window.
+     * @param rangeMinY Minimum Y coordinate of the query window.
+     * @param rangeMaxX Maximum X coordinate of the query window.
+     * @param rangeMaxY Maximum Y coordinate of the query window.
+     * @param slots Output buffer receiving the positions of intersecting entries.
+     * @return The number of positions written to slots.
+     */
+    uint32_t filterRange(const float* minX, const float* minY, const float* maxX, const float* maxY,
+                         int count,
+                         float rangeMinX, float rangeMinY, float rangeMaxX, float rangeMaxY,
+                         int* slots);
+
+    /**
+     * @brief Counts the entries of a node intersecting a query window without materialising them.
+     *
+     * Same sweep as sweepRange, reduced to a population count of the per-block hit masks.
+     *
+     * @param minX Minimum X coordinates of the entries (32-byte aligned).
+     * @param minY Minimum Y coordinates of the entries (32-byte aligned).
+     * @param maxX Maximum X coordinates of the entries (32-byte aligned).
+     * @param maxY Maximum Y coordinates of the entries (32-byte aligned).
+     * @param count Number of valid entries.
+     * @param rangeMinX Minimum X coordinate of the query window.
+     * @param rangeMinY Minimum Y coordinate of the query window.
+     * @param rangeMaxX Maximum X coordinate of the query window.
+     * @param rangeMaxY Maximum Y coordinate of the query window.
+     * @return The number of intersecting entries.
+     */
+    uint32_t countRange(const float* minX, const float* minY, const float* maxX, const float* maxY,
+                        int count,
+                        float rangeMinX, float rangeMinY, float rangeMaxX, float rangeMaxY);
+
+    /**
+     * @brief Computes the distance from a point to every entry of a node, keeping those nearer than a bound.
+     *
+     * The squared minimum distance (MINDIST) to each entry box is computed SIMD_WIDTH entries at
+     * a time, without branches, and the lanes below the bound are compressed into the output
+     * buffers, so only the entries that can still improve a k-nearest-neighbour result are
+     * handed to the caller's heap. The padding lanes past count are masked off.
+     *
+     * Both output buffers must have room for count rounded up to SIMD_WIDTH values.
+     *
+     * @param minX Minimum X coordinates of the entries (32-byte aligned).
+     * @param minY Minimum Y coordinates of the entries (32-byte aligned).
+     * @param maxX Maximum X coordinates of the entries (32-byte aligned).
+     * @param maxY Maximum Y coordinates of the entries (32-byte aligned).
+     * @param count Number of valid entries.
+     * @param x X coordinate of the query point.
+     * @param y Y coordinate of the query point.
+     * @param bound Exclusive upper bound on the squared distance; infinity keeps every entry.
+     * @param distances Output buffer receiving the squared distances of the kept entries.
+     * @param slots Output buffer receiving the positions of the kept entries.
+     * @return The number of entries kept.
+     */
+    uint32_t filterDistance(const float* minX, const float* minY, const float* maxX, const float* maxY,
+                            int count, float x, float y, float bound,
+                            float* distances, int* slots);
+
+    /**
+     * @brief Box version of filterDistance: computes the squared minimum distance between a query
+     * box and every entry of a node.
+     *
+     * @param qMinX Minimum X coordinate of the query box.
+     * @param qMinY Minimum Y coordinate of the query box.
+     * @param qMaxX Maximum X coordinate of the query box.
+     * @param qMaxY Maximum Y coordinate of the query box.
+     */
+    uint32_t filterDistance(const float* minX, const float* minY, const float* maxX, const float* maxY,
+                            int count, float qMinX, float qMinY, float qMaxX, float qMaxY, float bound,
+                            float* distances, int* slots);
+
+    /**
+     * @brief Joins two runs of minX-sorted entries with a forward plane sweep.
+     *
+     * The run whose next entry starts first is advanced and that entry is tested against the
+     * entries of the other run that start before it ends, SIMD_WIDTH at a time, so every
+     * intersecting pair is found exactly once without a full nested loop.
+     *
+     * Both runs must be followed by at least SIMD_WIDTH padding entries, as the vector loads
+     * are unaligned and may start at any entry; the lanes past the run are masked off. The output
+     * buffers need room for the number of pairs plus SIMD_WIDTH.
+     *
+     * @param aMinX Minimum X coordinates of the first run.
+     * @param aMinY Minimum Y coordinates of the first run.
+     * @param aMaxX Maximum X coordinates of the first run.
+     * @param aMaxY Maximum Y coordinates of the first run.
+     * @param aIds IDs of the first run.
+     * @param countA Number of entries in the first run.
+     * @param bMinX Minimum X coordinates of the second run.
+     * @param bMinY Minimum Y coordinates of the second run.
+     * @param bMaxX Maximum X coordinates of the second run.
+     * @param bMaxY Maximum Y coordinates of the second run.
+     * @param bIds IDs of the second run.
+     * @param countB Number of entries in the second run.
+     * @param outA Output buffer receiving the first-run id of every intersecting pair.
+     * @param outB Output buffer receiving the second-run id of every intersecting pair.
+     * @return The number of pairs written.
+     */
+    uint32_t sweepJoin(const float* aMinX, const float* aMinY, const float* aMaxX, const float* aMaxY,
+                       const int* aIds, int countA,
+                       const float* bMinX, const float* bMinY, const float* bMaxX, const float* bMaxY,
+                       const int* bIds, int countB,
+                       int* outA, int* outB);
+
+    /**
+     * @brief Filters quantised entry boxes against a query window quantised to the same frame.
+     *
+     * Entries are given as structure-of-arrays integer codes sorted by minX, with the minima
+     * rounded down and the maxima rounded up, and the query window with its minima rounded
+     * down and its maxima rounded up. Every entry whose code box intersects the query codes
+     * is a candidate. Candidates whose code box lies strictly inside the query codes also
+     * lie inside the exact window and are reported separately from those on its boundary,
+     * which need refinement against their exact boxes.
+     *
+     * Blocks of 16 (8 for 16-bit codes) entries are tested per instruction, so the arrays must
+     * be readable CODE_PADDING codes past count. The sweep stops after the first block that
+     * reaches past the query's maxX code.
+     *
+     * @param minX Minimum X codes of the entries.
+     * @param minY Minimum Y codes of the entries.
+     * @param maxX Maximum X codes of the entries.
+     * @param maxY Maximum Y codes of the entries.
+     * @param count Number of valid entries.
+     * @param qMinX Minimum X code of the query window.
+     * @param qMinY Minimum Y code of the query window.
+     * @param qMaxX Maximum X code of the query window.
+     * @param qMaxY Maximum Y code of the query window.
+     * @param boundary Output buffer with room for count positions, receiving the boundary candidates.
+     * @param inside Output buffer with room for count positions, receiving the inside candidates;
+     *               may be null, in which case they are only counted.
+     * @return The number of boundary and inside candidates.
+     */
+    CodeHits filterCodes(const uint8_t* minX, const uint8_t* minY, const uint8_t* maxX, const uint8_t* maxY,
+                         int count, uint8_t qMinX, uint8_t qMinY, uint8_t qMaxX, uint8_t qMaxY,
+                         int* boundary, int* inside);
+
+    /**
+     * @brief 16-bit version of filterCodes.
+     */
+    CodeHits filterCodes(const uint16_t* minX, const uint16_t* minY, const uint16_t* maxX, const uint16_t* maxY,
+                         int count, uint16_t qMinX, uint16_t qMinY, uint16_t qMaxX, uint16_t qMaxY,
+                         int* boundary, int* inside);
+
+}
+
+#endif // SIMDKERNELS_H
@@ -0,0 +1,84 @@
+#pragma once
+
+#ifndef PARALLELSORT_H
+#define PARALLELSORT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace rtree {
+
+    /**
+     * Below this many elements a parallel sort falls back to std::sort.
+     */
+    constexpr std::size_t PARALLEL_SORT_CUTOFF = 1 << 14;
+
+    /**
+     * @brief Sorts a range on the workers of a thread pool.
+     *
+     * The range is split into one run per worker, the runs are sorted concurrently and then
+     * merged pairwise in parallel rounds through a scratch buffer. The comparator must define
+     * a strict total order for the result to be independent of the number of workers.
+     *
+     * @param first Iterator to the first element.
+     * @param last Iterator past the last element.
+     * @param comp Comparator.
+     * @param pool The thread pool to run on.
+     */
+    template<typename RandomIt, typename Compare>
+    void parallelSort(RandomIt first, RandomIt last, Compare comp, ThreadPool& pool) {
+        const std::size_t n = static_cast<std::size_t>(last - first);
+        const std::size_t runs = std::min<std::size_t>(pool.size(), n / (PARALLEL_SORT_CUTOFF / 2) + 1);
+        if (runs <= 1 || n < PARALLEL_SORT_CUTOFF) {
+            std::sort(first, last, comp);
+            return;
+        }
+
+        std::vector<std::size_t> bounds(runs + 1);
+        for (std::size_t i = 0; i <= runs; i++) bounds[i] = n * i / runs;
+
+        pool.parallelFor(runs, 1, [&](std::size_t begin, std::size_t end, int) {
+            for (std::size_t r = begin; r < end; r++) {
+                std::sort(first + bounds[r], first + bounds[r + 1], comp);
+            }
+        });
+
+        using Value = typename std::iterator_traits<RandomIt>::value_type;
+        std::vector<Value> buffer(std::make_move_iterator(first), std::make_move_iterator(last));
+        auto src = buffer.begin();
+        auto dst = first;
+        bool dataInBuffer = true;
+
+        for (std::size_t width = 1; width < runs; width *= 2) {
+            const std::size_t pairs = (runs + 2 * width - 1) / (2 * width);
+            pool.parallelFor(pairs, 1, [&](std::size_t begin, std::size_t end, int) {
+                for (std::size_t p = begin; p < end; p++) {
+                    const std::size_t lo = bounds[p * 2 * width];
+                    const std::size_t mid = bounds[std::min(p * 2 * width + width, runs)];
+                    const std::size_t hi = bounds[std::min(p * 2 * width + 2 * width, runs)];
+                    if (dataInBuffer) {
+                        std::merge(std::make_move_iterator(src + lo), std::make_move_iterator(src + mid),
+                                   std::make_move_iterator(src + mid), std::make_move_iterator(src + hi),
+                                   dst + lo, comp);
+                    } else {
+                        std::merge(std::make_move_iterator(dst + lo), std::make_move_iterator(dst + mid),
+                                   std::make_move_iterator(dst + mid), std::make_move_iterator(dst + hi),
+                                   src + lo, comp);
+                    }
+                }
+            });
+            dataInBuffer = !dataInBuffer;
+        }
+
+        if (dataInBuffer) {
+            std::move(buffer.begin(), buffer.end(), first);
+        }
+    }
+
+}
+
+#endif // PARALLELSORT_H
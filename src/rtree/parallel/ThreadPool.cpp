@@ -0,0 +1,101 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace rtree {
+
+    ThreadPool::ThreadPool(int threads) {
+        if (threads <= 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        m_size = threads;
+        for (int i = 1; i < threads; i++) {
+            m_workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::run(const std::function<void(int)>& job) {
+        if (m_size == 1) {
+            job(0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = &job;
+            m_pending = m_size - 1;
+            m_error = nullptr;
+            m_generation++;
+        }
+        m_wake.notify_all();
+
+        std::exception_ptr error;
+        try {
+            job(0);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_pending == 0; });
+        m_job = nullptr;
+        if (!error) error = m_error;
+        lock.unlock();
+
+        if (error) std::rethrow_exception(error);
+    }
+
+    void ThreadPool::parallelFor(std::size_t count, std::size_t grain,
+                                 const std::function<void(std::size_t, std::size_t, int)>& body) {
+        grain = std::max<std::size_t>(grain, 1);
+        std::atomic<std::size_t> next{0};
+
+        run([&](int worker) {
+            for (std::size_t begin = next.fetch_add(grain); begin < count; begin = next.fetch_add(grain)) {
+                body(begin, std::min(begin + grain, count), worker);
+            }
+        });
+    }
+
+    int ThreadPool::size() const {
+        return m_size;
+    }
+
+    void ThreadPool::workerLoop(int index) {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while (true) {
+            m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+            if (m_stop) return;
+            seen = m_generation;
+            const auto* job = m_job;
+            lock.unlock();
+
+            try {
+                (*job)(index);
+            } catch (...) {
+                std::lock_guard<std::mutex> errorLock(m_mutex);
+                if (!m_error) m_error = std::current_exception();
+            }
+
+            lock.lock();
+            if (--m_pending == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+
+}
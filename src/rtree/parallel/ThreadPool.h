@@ -0,0 +1,87 @@
+#pragma once
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rtree {
+
+    /**
+     * Fixed-size pool of worker threads used by the batched query and parallel build paths.
+     *
+     * The calling thread takes part in every job as worker 0, so a pool of size 1 runs
+     * everything inline. Jobs must not submit further jobs to the same pool.
+     */
+    class ThreadPool {
+
+    public:
+
+        /**
+         * Constructor.
+         * @param threads Number of workers including the calling thread; 0 uses every hardware thread.
+         */
+        explicit ThreadPool(int threads = 0);
+
+        /**
+         * Destructor - stops and joins the worker threads.
+         */
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * Run a job on every worker and wait for all of them to finish.
+         * The first exception thrown by any worker is rethrown on the calling thread.
+         * @param job Callable invoked once per worker with the worker index in [0, size()).
+         */
+        void run(const std::function<void(int)>& job);
+
+        /**
+         * Split [0, count) into chunks of at most grain items and process them on all workers,
+         * handing out chunks dynamically so uneven work is balanced.
+         * @param count Number of items.
+         * @param grain Maximum number of items per chunk.
+         * @param body Callable invoked as body(begin, end, worker) for every chunk.
+         */
+        void parallelFor(std::size_t count, std::size_t grain,
+                         const std::function<void(std::size_t, std::size_t, int)>& body);
+
+        /**
+         * @return The number of workers, including the calling thread.
+         */
+        [[nodiscard]] int size() const;
+
+    private:
+
+        /**
+         * Main loop of a background worker.
+         * @param index The worker index.
+         */
+        void workerLoop(int index);
+
+        int m_size;
+        std::vector<std::thread> m_workers;
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+
+        const std::function<void(int)>* m_job = nullptr;
+        uint64_t m_generation = 0;
+        int m_pending = 0;
+        bool m_stop = false;
+        std::exception_ptr m_error;
+    };
+
+}
+
+#endif // THREADPOOL_H
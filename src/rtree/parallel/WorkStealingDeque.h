@@ -0,0 +1,67 @@
+#pragma once
+
+#ifndef WORKSTEALINGDEQUE_H
+#define WORKSTEALINGDEQUE_H
+
+#include <deque>
+#include <mutex>
+
+namespace rtree {
+
+    /**
+     * Per-worker task deque of a work-stealing scheduler.
+     *
+     * The owning worker pushes and pops at the back, so it works depth-first on the tasks it
+     * created last; idle workers steal from the front, taking the oldest and typically largest
+     * tasks. Each deque is guarded by its own mutex, which is uncontended unless a steal is in
+     * progress.
+     */
+    template<typename Task>
+    class WorkStealingDeque {
+
+    public:
+
+        /**
+         * Add a task at the owner's end.
+         * @param task The task.
+         */
+        void push(const Task& task) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(task);
+        }
+
+        /**
+         * Take the most recently pushed task. Called by the owning worker.
+         * @param task Receives the task.
+         * @return False if the deque is empty.
+         */
+        bool pop(Task& task) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_tasks.empty()) return false;
+            task = m_tasks.back();
+            m_tasks.pop_back();
+            return true;
+        }
+
+        /**
+         * Take the oldest task. Called by other workers.
+         * @param task Receives the task.
+         * @return False if the deque is empty.
+         */
+        bool steal(Task& task) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_tasks.empty()) return false;
+            task = m_tasks.front();
+            m_tasks.pop_front();
+            return true;
+        }
+
+    private:
+
+        std::mutex m_mutex;
+        std::deque<Task> m_tasks;
+    };
+
+}
+
+#endif // WORKSTEALINGDEQUE_H
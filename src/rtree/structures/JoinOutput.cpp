@@ -0,0 +1,117 @@
+#include "JoinOutput.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace rtree {
+
+    namespace {
+
+        /**
+         * Number of pairs a BinaryFileJoinSink stages before writing them out.
+         */
+        constexpr std::size_t FILE_SINK_PAIRS = 1 << 16;
+    }
+
+    void ChunkedJoinBuffer::accept(const int* idsA, const int* idsB, uint32_t count) {
+        m_size += count;
+        while (count > 0) {
+            if (m_used == 0 || m_chunks[m_used - 1].count == JOIN_CHUNK_PAIRS) {
+                if (m_used == m_chunks.size()) {
+                    Storage storage;
+                    storage.idsA = std::make_unique<int[]>(JOIN_CHUNK_PAIRS);
+                    storage.idsB = std::make_unique<int[]>(JOIN_CHUNK_PAIRS);
+                    m_chunks.push_back(std::move(storage));
+                }
+                m_chunks[m_used++].count = 0;
+            }
+
+            Storage& chunk = m_chunks[m_used - 1];
+            const uint32_t n = std::min(count, JOIN_CHUNK_PAIRS - chunk.count);
+            std::copy(idsA, idsA + n, chunk.idsA.get() + chunk.count);
+            std::copy(idsB, idsB + n, chunk.idsB.get() + chunk.count);
+            chunk.count += n;
+            idsA += n;
+            idsB += n;
+            count -= n;
+        }
+    }
+
+    void ChunkedJoinBuffer::clear() {
+        m_used = 0;
+        m_size = 0;
+    }
+
+    uint64_t ChunkedJoinBuffer::size() const {
+        return m_size;
+    }
+
+    std::size_t ChunkedJoinBuffer::chunkCount() const {
+        return m_used;
+    }
+
+    ChunkedJoinBuffer::Chunk ChunkedJoinBuffer::chunk(std::size_t index) const {
+        const Storage& chunk = m_chunks[index];
+        return {chunk.idsA.get(), chunk.idsB.get(), chunk.count};
+    }
+
+    BinaryFileJoinSink::BinaryFileJoinSink(const std::string& path)
+        : m_buffer(2 * FILE_SINK_PAIRS), m_path(path) {
+        m_file = std::fopen(path.c_str(), "wb");
+        if (!m_file) {
+            throw std::runtime_error("Unable to open join output file " + path);
+        }
+    }
+
+    BinaryFileJoinSink::~BinaryFileJoinSink() {
+        if (m_file) {
+            try {
+                close();
+            } catch (...) {
+                // Errors can only be reported through an explicit close().
+            }
+        }
+    }
+
+    void BinaryFileJoinSink::accept(const int* idsA, const int* idsB, uint32_t count) {
+        if (!m_file) {
+            throw std::runtime_error("Join output file " + m_path + " is closed");
+        }
+        m_size += count;
+        for (uint32_t i = 0; i < count; i++) {
+            if (m_staged == FILE_SINK_PAIRS) flush();
+            m_buffer[2 * m_staged] = idsA[i];
+            m_buffer[2 * m_staged + 1] = idsB[i];
+            m_staged++;
+        }
+    }
+
+    void BinaryFileJoinSink::close() {
+        if (!m_file) return;
+        flush();
+        const int result = std::fclose(m_file);
+        m_file = nullptr;
+        if (result != 0) {
+            throw std::runtime_error("Unable to write join output file " + m_path);
+        }
+    }
+
+    uint64_t BinaryFileJoinSink::size() const {
+        return m_size;
+    }
+
+    void BinaryFileJoinSink::flush() {
+        if (m_staged == 0) return;
+        if (!m_file) {
+            throw std::runtime_error("Join output file " + m_path + " is closed");
+        }
+        const std::size_t written = std::fwrite(m_buffer.data(), 2 * sizeof(int32_t), m_staged, m_file);
+        if (written != m_staged) {
+            std::fclose(m_file);
+            m_file = nullptr;
+            throw std::runtime_error("Unable to write join output file " + m_path);
+        }
+        m_staged = 0;
+    }
+
+}
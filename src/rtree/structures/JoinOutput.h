@@ -0,0 +1,134 @@
+#pragma once
+
+#ifndef JOINOUTPUT_H
+#define JOINOUTPUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Results.h"
+
+namespace rtree {
+
+    /**
+     * Number of pairs per chunk of a ChunkedJoinBuffer.
+     */
+    constexpr uint32_t JOIN_CHUNK_PAIRS = 1 << 16;
+
+    /**
+     * Join sink collecting the pairs in fixed-size columnar chunks.
+     *
+     * Pairs are stored as two flat id columns per chunk. Growing the buffer allocates a new
+     * chunk instead of reallocating and copying what was already collected, and clear() keeps
+     * the chunks so a reused buffer stops allocating once it has reached its largest size.
+     */
+    class ChunkedJoinBuffer final : public JoinSink {
+
+    public:
+
+        /**
+         * A read-only view of one chunk.
+         */
+        struct Chunk {
+            const int* idsA;
+            const int* idsB;
+            uint32_t count;
+        };
+
+        void accept(const int* idsA, const int* idsB, uint32_t count) override;
+
+        /**
+         * Forget the collected pairs, keeping the chunks for reuse.
+         */
+        void clear();
+
+        /**
+         * @return The number of collected pairs.
+         */
+        [[nodiscard]] uint64_t size() const;
+
+        /**
+         * @return The number of chunks holding pairs.
+         */
+        [[nodiscard]] std::size_t chunkCount() const;
+
+        /**
+         * @param index The chunk index in [0, chunkCount()).
+         * @return A view of the pairs of the chunk, in the order they were accepted.
+         */
+        [[nodiscard]] Chunk chunk(std::size_t index) const;
+
+    private:
+
+        struct Storage {
+            std::unique_ptr<int[]> idsA;
+            std::unique_ptr<int[]> idsB;
+            uint32_t count = 0;
+        };
+
+        std::vector<Storage> m_chunks;
+        std::size_t m_used = 0;
+        uint64_t m_size = 0;
+    };
+
+    /**
+     * Join sink streaming the pairs to a binary file as they are produced, so the output
+     * never needs to fit in memory.
+     *
+     * The file is a flat sequence of (idA, idB) records of two native-endian int32 values.
+     * Pairs are staged in a fixed buffer and written whenever it fills up.
+     */
+    class BinaryFileJoinSink final : public JoinSink {
+
+    public:
+
+        /**
+         * Constructor - creates or truncates the file.
+         * @param path Path of the output file.
+         * @throws std::runtime_error If the file cannot be opened.
+         */
+        explicit BinaryFileJoinSink(const std::string& path);
+
+        /**
+         * Destructor - writes any staged pairs and closes the file.
+         */
+        ~BinaryFileJoinSink() override;
+
+        BinaryFileJoinSink(const BinaryFileJoinSink&) = delete;
+        BinaryFileJoinSink& operator=(const BinaryFileJoinSink&) = delete;
+
+        void accept(const int* idsA, const int* idsB, uint32_t count) override;
+
+        /**
+         * Write the staged pairs and close the file, reporting write errors. Any later
+         * accept() throws, so pairs produced after closing are never silently dropped.
+         * @throws std::runtime_error If writing fails.
+         */
+        void close();
+
+        /**
+         * @return The number of pairs accepted.
+         */
+        [[nodiscard]] uint64_t size() const;
+
+    private:
+
+        /**
+         * Write the staged pairs to the file.
+         */
+        void flush();
+
+        std::FILE* m_file = nullptr;
+        std::vector<int32_t> m_buffer;
+        std::size_t m_staged = 0;
+        uint64_t m_size = 0;
+        std::string m_path;
+    };
+
+}
+
+#endif // JOINOUTPUT_H
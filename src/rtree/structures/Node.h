@@ -3,50 +3,29 @@
 #ifndef NODE_H
 #define NODE_H
 
-#include <cmath>
-#include <vector>
-#include <algorithm>
-
-#include "Rectangle.h"
+#include <array>
+#include <limits>
 
 namespace rtree {
 
     /**
-     * Node class representing a single node within an R-tree.
+     * Node class representing a single node within an R-tree with D coordinates of type T.
      * Nodes can either contain child nodes (internal nodes) or leaf rectangles (leaf nodes).
+     *
+     * A node only holds its own header; its entries (leaf rectangles or the MBRs and ids of its
+     * children) live in the structure-of-arrays storage of the NodeStore that owns it, at the
+     * slot block given by nodeId. Children are referenced by node id, never by pointer.
      */
-    class Node {
+    template<int D, typename T>
+    class BasicNode {
 
     public:
 
         /**
-         * Child nodes (only used if this is an internal node).
-         */
-        std::vector<Node*> children;
-
-        /**
-         * Leaf rectangles (only used if this is a leaf node).
-         */
-        std::vector<Rectangle> leafs;
-
-        /**
-         * IDs corresponding to the leaf rectangles (only used if this is a leaf node).
-         */
-        std::vector<int> ids;
-
-        /**
-         * Unique identifier for the node.
+         * Unique identifier for the node. Also its index in the owning NodeStore.
          */
         int nodeId{};
 
-        /**
-         * Minimum bounding rectangle (MBR) of this node.
-         */
-        float mbrMinX = MAXFLOAT;
-        float mbrMinY = MAXFLOAT;
-        float mbrMaxX = -MAXFLOAT;
-        float mbrMaxY = -MAXFLOAT;
-
         /**
          * The level of the node in the tree.
          * Level 1 nodes are leaf nodes, while higher levels are internal nodes.
@@ -59,94 +38,100 @@ namespace rtree {
         int entryCount{};
 
         /**
-         * Constructor for internal nodes.
-         * @param id Node identifier.
-         * @param level Level of the node within the tree.
-         * @param capacity Maximum number of entries this node can hold.
+         * Number of leaf rectangles in the subtree rooted at this node; entryCount for leaves.
+         * Lets a range count take a fully contained subtree without walking it.
          */
-        Node(int id, int level, int capacity);
+        int subtreeCount{};
 
         /**
-         * Constructor for leaf nodes or empty nodes.
-         * @param capacity Maximum number of entries this node can hold.
+         * Minimum bounding rectangle (MBR) of this node: mbrMin[d] and mbrMax[d] are its
+         * bounds on axis d.
          */
-        Node(int capacity);
+        std::array<T, D> mbrMin;
+        std::array<T, D> mbrMax;
 
         /**
-         * Destructor - cleans up child pointers if necessary.
-         */
-        ~Node();
-
-        /**
-         * Add a child node to this node (used for internal nodes).
-         * Updates the MBR to include the new child node.
-         * @param n Pointer to the child node being added.
-         */
-        void addChildEntry(Node* n);
-
-        /**
-         * Add a leaf rectangle to this node (used for leaf nodes).
-         * Updates the MBR to include the new rectangle.
-         * @param rect The rectangle being added.
-         */
-        void addLeafEntry(const Rectangle& rect);
-
-        /**
-         * Sort the child nodes by their minimum X coordinate.
-         * This is useful for certain spatial queries and tree rebalancing.
+         * Constructor.
+         * @param id Node identifier.
+         * @param level Level of the node within the tree.
          */
-        void sortChildrenByMinX();
+        BasicNode(int id, int level) : nodeId(id), level(level) {
+            resetMBR();
+        }
 
         /**
-         * Sort the leaf rectangles by their minimum X coordinate.
-         * This is useful for certain spatial queries and tree rebalancing.
+         * Constructor for an empty, unassigned node.
          */
-        void sortLeafsByMinX();
+        BasicNode() {
+            resetMBR();
+        }
 
         /**
-         * Delete an entry by index.
-         * @param index Index of the entry to remove.
+         * Enlarge the MBR of this node to include the given box.
+         * @param min Minimum corner of the box.
+         * @param max Maximum corner of the box.
          */
-        void deleteEntry(int index);
+        void expandMBR(const T* min, const T* max) {
+            for (int d = 0; d < D; d++) {
+                if (min[d] < mbrMin[d]) mbrMin[d] = min[d];
+                if (max[d] > mbrMax[d]) mbrMax[d] = max[d];
+            }
+        }
 
         /**
-         * Recalculate the minimum bounding rectangle (MBR) for the node.
-         * Iterates over all current entries to compute the MBR.
+         * Reset the MBR of this node to the empty box.
          */
-        void recalculateMBR();
+        void resetMBR() {
+            mbrMin.fill(std::numeric_limits<T>::max());
+            mbrMax.fill(std::numeric_limits<T>::lowest());
+        }
 
         /**
          * Get the current number of entries in this node.
          * @return The number of entries (either children or leaf rectangles).
          */
-        [[nodiscard]] int getEntryCount() const;
+        [[nodiscard]] int getEntryCount() const { return entryCount; }
 
         /**
          * Get the unique identifier of this node.
          * @return Node ID.
          */
-        [[nodiscard]] int getNodeId() const;
+        [[nodiscard]] int getNodeId() const { return nodeId; }
 
         /**
          * Check if this node is a leaf node.
          * Leaf nodes contain rectangles; internal nodes contain child nodes.
          * @return True if this is a leaf node, false if internal.
          */
-        [[nodiscard]] bool isLeaf() const;
+        [[nodiscard]] bool isLeaf() const { return level == 1; }
 
         /**
          * Get the level of this node within the tree.
-         * @return Level (0 for leaf nodes, higher values for internal nodes).
+         * @return Level (1 for leaf nodes, higher values for internal nodes).
          */
-        [[nodiscard]] int getLevel() const;
+        [[nodiscard]] int getLevel() const { return level; }
 
         /**
          * Check if the node is empty (contains no entries).
          * @return True if empty, false otherwise.
          */
-        [[nodiscard]] bool isEmpty() const;
+        [[nodiscard]] bool isEmpty() const { return entryCount == 0; }
     };
 
+    /**
+     * Pointers to the entry arrays of a single node: min[d][i] and max[d][i] are the bounds of
+     * entry i on axis d. For leaf nodes ids are rectangle ids; for internal nodes they are child node ids.
+     */
+    template<int D, typename T>
+    struct BasicNodeEntries {
+        std::array<T*, D> min;
+        std::array<T*, D> max;
+        int* ids;
+    };
+
+    using Node = BasicNode<2, float>;
+    using NodeEntries = BasicNodeEntries<2, float>;
+
 }
 
 #endif // NODE_H
@@ -0,0 +1,490 @@
+#include "NodeStore.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <sys/mman.h>
+
+namespace rtree {
+
+    namespace {
+
+        constexpr std::size_t BLOCK_ALIGNMENT = 64;
+        constexpr std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+        std::size_t alignUp(std::size_t value, std::size_t alignment) {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        /**
+         * Byte offsets of the node headers and of each entry array inside an arena block:
+         * min[0..D-1], then max[0..D-1], then the ids. The inline layout has no separate arrays;
+         * its total is nodeCount node blocks of nodeBytes each.
+         */
+        template<int D, typename T>
+        struct BlockLayout {
+            std::array<std::size_t, D> min, max;
+            std::size_t ids, total;
+
+            BlockLayout(std::size_t nodeCount, std::size_t stride, bool inlined, std::size_t nodeBytes) {
+                if (inlined) {
+                    min.fill(0);
+                    max.fill(0);
+                    ids = 0;
+                    total = nodeCount * nodeBytes;
+                    return;
+                }
+                const std::size_t coordinates = alignUp(nodeCount * stride * sizeof(T), BLOCK_ALIGNMENT);
+                const std::size_t ints = alignUp(nodeCount * stride * sizeof(int), BLOCK_ALIGNMENT);
+                std::size_t offset = alignUp(nodeCount * sizeof(BasicNode<D, T>), BLOCK_ALIGNMENT);
+                for (int d = 0; d < D; d++, offset += coordinates) min[d] = offset;
+                for (int d = 0; d < D; d++, offset += coordinates) max[d] = offset;
+                ids = offset;
+                total = ids + ints;
+            }
+        };
+
+        /**
+         * @return The layout of an arena block for nodeCount nodes of a store.
+         */
+        template<int D, typename T, int Capacity>
+        BlockLayout<D, T> blockLayout(int stride, std::size_t nodeCount) {
+            using Store = BasicNodeStore<D, T, Capacity>;
+            return BlockLayout<D, T>(nodeCount, stride, Store::INLINE, Store::nodeBytes());
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    BasicNodeStore<D, T, Capacity>::BasicNodeStore(int capacity, bool hugePages) :
+        m_capacity(INLINE ? Capacity : capacity),
+        m_stride((m_capacity + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH),
+        m_hugePages(hugePages)
+    {}
+
+    template<int D, typename T, int Capacity>
+    BasicNodeStore<D, T, Capacity>::~BasicNodeStore() {
+        release();
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::reserve(int nodeCount) {
+        if (nodeCount > m_reserved) {
+            grow(nodeCount);
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::clear() {
+        m_size = 0;
+        m_freeNodes.clear();
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::attach(void* image, int nodeCount) {
+        release();
+        m_attached = true;
+        m_block = image;
+        m_blockBytes = blockLayout<D, T, Capacity>(m_stride, nodeCount).total;
+        m_size = nodeCount;
+        // Entries are updated in the image itself; the next allocation moves the nodes into an own block.
+        m_reserved = 0;
+        setBlock(image, nodeCount);
+    }
+
+    template<int D, typename T, int Capacity>
+    int BasicNodeStore<D, T, Capacity>::imageSize() const {
+        int count = 0;
+        for (int id = 0; id < m_size; id++) {
+            count += node(id).level != 0;
+        }
+        return count;
+    }
+
+    template<int D, typename T, int Capacity>
+    int BasicNodeStore<D, T, Capacity>::imageNodeId(int nodeId) const {
+        int imageId = 0;
+        for (int id = 0; id < nodeId; id++) {
+            imageId += node(id).level != 0;
+        }
+        return imageId;
+    }
+
+    template<int D, typename T, int Capacity>
+    std::size_t BasicNodeStore<D, T, Capacity>::imageBytes() const {
+        return blockLayout<D, T, Capacity>(m_stride, imageSize()).total;
+    }
+
+    template<int D, typename T, int Capacity>
+    bool BasicNodeStore<D, T, Capacity>::writeImage(std::FILE* file) const {
+        const std::vector<int> imageIds = this->imageIds();
+        const int count = static_cast<int>(std::count_if(imageIds.begin(), imageIds.end(), [](int id) { return id >= 0; }));
+        const BlockLayout<D, T> layout = blockLayout<D, T, Capacity>(m_stride, count);
+        const std::size_t slots = static_cast<std::size_t>(m_size) * m_stride;
+        std::size_t position = 0;
+
+        // Write a region at its offset in the image, zero-filling the alignment gap before it.
+        auto write = [&](std::size_t offset, const void* data, std::size_t bytes) {
+            static const char zeros[BLOCK_ALIGNMENT] = {};
+            if (std::fwrite(zeros, 1, offset - position, file) != offset - position) return false;
+            if (bytes > 0 && std::fwrite(data, 1, bytes, file) != bytes) return false;
+            position = offset + bytes;
+            return true;
+        };
+
+        if (count == m_size) {
+            // No released nodes: the arena is already the image.
+            if (INLINE) {
+                return write(0, m_block, layout.total);
+            }
+            if (!write(0, m_nodes, m_size * sizeof(Node))) return false;
+            for (int d = 0; d < D; d++) {
+                if (!write(layout.min[d], m_min[d], slots * sizeof(T))) return false;
+            }
+            for (int d = 0; d < D; d++) {
+                if (!write(layout.max[d], m_max[d], slots * sizeof(T))) return false;
+            }
+            return write(layout.ids, m_ids, slots * sizeof(int)) &&
+                   write(layout.total, nullptr, 0);
+        }
+
+        // Copy of the ids of a node with the child ids of an internal node renumbered.
+        std::vector<int> ids(m_stride);
+        auto renumber = [&](int nodeId) {
+            const int* source = entries(nodeId).ids;
+            std::copy(source, source + m_stride, ids.begin());
+            if (!node(nodeId).isLeaf()) {
+                for (int i = 0; i < node(nodeId).entryCount; i++) ids[i] = imageIds[ids[i]];
+            }
+        };
+
+        if (INLINE) {
+            std::vector<char> block(BLOCK_BYTES);
+            for (int id = 0; id < m_size; id++) {
+                if (imageIds[id] < 0) continue;
+                renumber(id);
+                std::memcpy(block.data(), &node(id), BLOCK_BYTES);
+                reinterpret_cast<Node*>(block.data())->nodeId = imageIds[id];
+                std::memcpy(block.data() + ENTRIES_OFFSET + 2 * D * ARRAY_BYTES, ids.data(), m_stride * sizeof(int));
+                if (!write(position, block.data(), BLOCK_BYTES)) return false;
+            }
+            return true;
+        }
+        for (int id = 0; id < m_size; id++) {
+            if (imageIds[id] < 0) continue;
+            Node header = node(id);
+            header.nodeId = imageIds[id];
+            if (!write(position, &header, sizeof(Node))) return false;
+        }
+        // Write the slots of the nodes in use of one entry array, starting at its offset.
+        auto writeArray = [&](std::size_t offset, const auto* values) {
+            if (!write(offset, nullptr, 0)) return false;
+            for (int id = 0; id < m_size; id++) {
+                if (imageIds[id] < 0) continue;
+                if (!write(position, values + static_cast<std::size_t>(id) * m_stride, m_stride * sizeof(*values))) return false;
+            }
+            return true;
+        };
+        for (int d = 0; d < D; d++) {
+            if (!writeArray(layout.min[d], m_min[d])) return false;
+        }
+        for (int d = 0; d < D; d++) {
+            if (!writeArray(layout.max[d], m_max[d])) return false;
+        }
+        if (!write(layout.ids, nullptr, 0)) return false;
+        for (int id = 0; id < m_size; id++) {
+            if (imageIds[id] < 0) continue;
+            renumber(id);
+            if (!write(position, ids.data(), m_stride * sizeof(int))) return false;
+        }
+        return write(layout.total, nullptr, 0);
+    }
+
+    template<int D, typename T, int Capacity>
+    int BasicNodeStore<D, T, Capacity>::createNode(int level) {
+        int id;
+        if (!m_freeNodes.empty()) {
+            id = m_freeNodes.back();
+            m_freeNodes.pop_back();
+        } else {
+            id = allocateNodes(1);
+        }
+        initNode(id, level);
+        return id;
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::releaseNode(int nodeId) {
+        // Level 0 marks the node as unused
+        initNode(nodeId, 0);
+        m_freeNodes.push_back(nodeId);
+    }
+
+    template<int D, typename T, int Capacity>
+    int BasicNodeStore<D, T, Capacity>::allocateNodes(int count) {
+        if (m_size + count > m_reserved) {
+            grow(std::max({16, m_reserved * 2, m_size + count}));
+        }
+        const int first = m_size;
+        m_size += count;
+        return first;
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::initNode(int nodeId, int level) {
+        new (&node(nodeId)) Node(nodeId, level);
+
+        const NodeEntries e = entries(nodeId);
+        for (int i = 0; i < m_stride; i++) {
+            clearEntry(e, i);
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::addChildEntry(int nodeId, int childId) {
+        const Node& child = node(childId);
+        Node& n = node(nodeId);
+        setEntry(entries(nodeId), n.entryCount++, child.mbrMin.data(), child.mbrMax.data(), childId);
+        n.expandMBR(child.mbrMin.data(), child.mbrMax.data());
+        n.subtreeCount += child.subtreeCount;
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::addLeafEntry(int nodeId, const Rectangle& rect) {
+        addLeafEntry(nodeId, rect.min.data(), rect.max.data(), rect.id);
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::addLeafEntry(int nodeId, const T* min, const T* max, int id) {
+        Node& n = node(nodeId);
+        setEntry(entries(nodeId), n.entryCount++, min, max, id);
+        n.expandMBR(min, max);
+        n.subtreeCount++;
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::readEntries(int nodeId, std::vector<Rectangle>& entries) const {
+        const int count = node(nodeId).entryCount;
+        const NodeEntries e = this->entries(nodeId);
+        entries.resize(count);
+        for (int i = 0; i < count; i++) {
+            for (int d = 0; d < D; d++) {
+                entries[i].min[d] = e.min[d][i];
+                entries[i].max[d] = e.max[d][i];
+            }
+            entries[i].id = e.ids[i];
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::writeEntries(int nodeId, const Rectangle* entries, int count) {
+        initNode(nodeId, node(nodeId).level);
+        Node& n = node(nodeId);
+        const NodeEntries e = this->entries(nodeId);
+        for (int i = 0; i < count; i++) {
+            const Rectangle& entry = entries[i];
+            setEntry(e, i, entry.min.data(), entry.max.data(), entry.id);
+            n.expandMBR(entry.min.data(), entry.max.data());
+        }
+        n.entryCount = count;
+        sortEntriesByMinX(nodeId);
+        recountSubtree(nodeId);
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::sortEntriesByMinX(int nodeId) {
+        const int count = node(nodeId).entryCount;
+        const NodeEntries e = entries(nodeId);
+
+        std::vector<int> order(count);
+        for (int i = 0; i < count; i++) order[i] = i;
+        std::sort(order.begin(), order.end(),
+            [&e](int a, int b) {
+                return e.min[0][a] < e.min[0][b];
+            });
+
+        // Apply the permutation to every array, keeping the padding slots untouched.
+        auto permute = [&](auto* values) {
+            std::vector<std::remove_pointer_t<decltype(values)>> sorted(count);
+            for (int i = 0; i < count; i++) sorted[i] = values[order[i]];
+            std::copy(sorted.begin(), sorted.end(), values);
+        };
+        for (int d = 0; d < D; d++) {
+            permute(e.min[d]);
+            permute(e.max[d]);
+        }
+        permute(e.ids);
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::deleteEntry(int nodeId, int index) {
+        Node& n = node(nodeId);
+        const NodeEntries e = entries(nodeId);
+
+        // Shift the tail left and restore the padding slot
+        for (int i = index; i < n.entryCount - 1; i++) {
+            for (int d = 0; d < D; d++) {
+                e.min[d][i] = e.min[d][i + 1];
+                e.max[d][i] = e.max[d][i + 1];
+            }
+            e.ids[i] = e.ids[i + 1];
+        }
+        n.entryCount--;
+        clearEntry(e, n.entryCount);
+
+        // Recalculate MBR after deletion
+        recalculateMBR(nodeId);
+        recountSubtree(nodeId);
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::recountSubtree(int nodeId) {
+        Node& n = node(nodeId);
+        if (n.isLeaf()) {
+            n.subtreeCount = n.entryCount;
+            return;
+        }
+        const NodeEntries e = entries(nodeId);
+        n.subtreeCount = 0;
+        for (int i = 0; i < n.entryCount; i++) {
+            n.subtreeCount += node(e.ids[i]).subtreeCount;
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::recalculateMBR(int nodeId) {
+        Node& n = node(nodeId);
+        const NodeEntries e = entries(nodeId);
+
+        // Leaf rectangles and child MBRs are both held in the entry arrays
+        n.resetMBR();
+        for (int i = 0; i < n.entryCount; i++) {
+            for (int d = 0; d < D; d++) {
+                if (e.min[d][i] < n.mbrMin[d]) n.mbrMin[d] = e.min[d][i];
+                if (e.max[d][i] > n.mbrMax[d]) n.mbrMax[d] = e.max[d][i];
+            }
+        }
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::setEntry(const NodeEntries& e, int slot, const T* min, const T* max, int id) {
+        for (int d = 0; d < D; d++) {
+            e.min[d][slot] = min[d];
+            e.max[d][slot] = max[d];
+        }
+        e.ids[slot] = id;
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::clearEntry(const NodeEntries& e, int slot) {
+        for (int d = 0; d < D; d++) {
+            e.min[d][slot] = std::numeric_limits<T>::max();
+            e.max[d][slot] = std::numeric_limits<T>::lowest();
+        }
+        e.ids[slot] = -1;
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::grow(int nodeCount) {
+        const BlockLayout<D, T> layout = blockLayout<D, T, Capacity>(m_stride, nodeCount);
+        std::size_t bytes;
+        void* block;
+        bool mapped = false;
+
+        if (m_hugePages) {
+            bytes = alignUp(layout.total, HUGE_PAGE_SIZE);
+            block = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (block == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+            madvise(block, bytes, MADV_HUGEPAGE);
+#endif
+            mapped = true;
+        } else {
+            bytes = alignUp(layout.total, BLOCK_ALIGNMENT);
+            block = std::aligned_alloc(BLOCK_ALIGNMENT, bytes);
+            if (!block) throw std::bad_alloc();
+        }
+
+        auto* base = static_cast<char*>(block);
+
+        // Carry over the nodes built so far
+        if (m_size > 0 && INLINE) {
+            std::memcpy(base, m_block, blockLayout<D, T, Capacity>(m_stride, m_size).total);
+        } else if (m_size > 0) {
+            const std::size_t slots = static_cast<std::size_t>(m_size) * m_stride;
+            std::memcpy(base, m_nodes, m_size * sizeof(Node));
+            for (int d = 0; d < D; d++) {
+                std::memcpy(base + layout.min[d], m_min[d], slots * sizeof(T));
+                std::memcpy(base + layout.max[d], m_max[d], slots * sizeof(T));
+            }
+            std::memcpy(base + layout.ids, m_ids, slots * sizeof(int));
+        }
+
+        release();
+        m_block = block;
+        m_blockBytes = bytes;
+        m_mapped = mapped;
+        m_reserved = nodeCount;
+        setBlock(block, nodeCount);
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::setBlock(void* block, int nodeCount) {
+        // Inline nodes are addressed from m_block alone.
+        if (INLINE) return;
+        const BlockLayout<D, T> layout = blockLayout<D, T, Capacity>(m_stride, nodeCount);
+        auto* base = static_cast<char*>(block);
+        m_nodes = reinterpret_cast<Node*>(base);
+        for (int d = 0; d < D; d++) {
+            m_min[d] = reinterpret_cast<T*>(base + layout.min[d]);
+            m_max[d] = reinterpret_cast<T*>(base + layout.max[d]);
+        }
+        m_ids = reinterpret_cast<int*>(base + layout.ids);
+    }
+
+    template<int D, typename T, int Capacity>
+    void BasicNodeStore<D, T, Capacity>::release() {
+        if (!m_block) return;
+        if (m_attached) {
+            // The image belongs to the caller of attach.
+        } else if (m_mapped) {
+            munmap(m_block, m_blockBytes);
+        } else {
+            std::free(m_block);
+        }
+        m_block = nullptr;
+        m_blockBytes = 0;
+        m_reserved = 0;
+        m_attached = false;
+    }
+
+    template<int D, typename T, int Capacity>
+    std::vector<int> BasicNodeStore<D, T, Capacity>::imageIds() const {
+        std::vector<int> ids(m_size, -1);
+        int next = 0;
+        for (int id = 0; id < m_size; id++) {
+            if (node(id).level != 0) ids[id] = next++;
+        }
+        return ids;
+    }
+
+    template class BasicNodeStore<2, float>;
+    template class BasicNodeStore<2, double>;
+    template class BasicNodeStore<2, int32_t>;
+    template class BasicNodeStore<3, float>;
+    template class BasicNodeStore<3, double>;
+    template class BasicNodeStore<3, int32_t>;
+
+    template class BasicNodeStore<2, float, 16>;
+    template class BasicNodeStore<2, float, 32>;
+    template class BasicNodeStore<2, float, 64>;
+    template class BasicNodeStore<2, float, 128>;
+    template class BasicNodeStore<3, float, 16>;
+    template class BasicNodeStore<3, float, 32>;
+    template class BasicNodeStore<3, float, 64>;
+    template class BasicNodeStore<3, float, 128>;
+
+}
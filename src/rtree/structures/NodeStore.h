@@ -0,0 +1,355 @@
+#pragma once
+
+#ifndef NODESTORE_H
+#define NODESTORE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+#include "Node.h"
+#include "Rectangle.h"
+#include "../kernels/SimdKernels.h"
+
+namespace rtree {
+
+    /**
+     * Arena owning every node of an R-tree.
+     *
+     * Node headers and the structure-of-arrays entry storage of all nodes are carved out of a
+     * single 64-byte aligned block (optionally backed by transparent huge pages). Each node owns
+     * a fixed block of stride() entry slots at nodeId * stride() in every coordinate array, so
+     * nodes are addressed by id and the whole tree is released at once on destruction.
+     * Nodes are laid out in creation order, which for a bulk load is level by level from the leaves up.
+     *
+     * The entry arrays are min[0..D-1] followed by max[0..D-1] and the ids, so for two
+     * dimensions they are minX, minY, maxX, maxY and ids.
+     *
+     * With a Capacity fixed at compile time the entries are stored inline instead: every node
+     * is one 64-byte aligned block of the header followed by its own entry arrays, so visiting
+     * a node touches a single contiguous region and its addresses are compile-time offsets.
+     *
+     * @tparam Capacity Maximum number of entries per node, or 0 to choose it at run time.
+     */
+    template<int D, typename T, int Capacity = 0>
+    class BasicNodeStore {
+
+        static_assert(Capacity >= 0, "Capacity must be positive, or 0 for a run-time capacity");
+
+    public:
+
+        using Node = BasicNode<D, T>;
+        using NodeEntries = BasicNodeEntries<D, T>;
+        using Rectangle = BasicRectangle<D, T>;
+
+        /**
+         * True if every node holds its entries inline in its own block.
+         */
+        static constexpr bool INLINE = Capacity > 0;
+
+        /**
+         * Entry slots per node of the inline layout: Capacity rounded up to SIMD_WIDTH.
+         */
+        static constexpr int INLINE_STRIDE = (Capacity + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+
+        /**
+         * Constructor.
+         * @param capacity Maximum number of entries per node; ignored when Capacity fixes it.
+         * @param hugePages Back the arena with transparent huge pages where the OS supports it.
+         */
+        explicit BasicNodeStore(int capacity, bool hugePages = false);
+
+        /**
+         * Destructor - releases the arena and with it every node.
+         */
+        ~BasicNodeStore();
+
+        BasicNodeStore(const BasicNodeStore&) = delete;
+        BasicNodeStore& operator=(const BasicNodeStore&) = delete;
+
+        /**
+         * Make room for at least nodeCount nodes, so that building a tree of known size
+         * needs a single allocation.
+         * @param nodeCount Number of nodes to reserve.
+         */
+        void reserve(int nodeCount);
+
+        /**
+         * Remove every node, keeping the allocation for reuse.
+         */
+        void clear();
+
+        /**
+         * Use an existing arena image, e.g. a memory-mapped index file, in place of an own
+         * allocation. The image must have the layout written by writeImage for the same
+         * capacity and stays owned by the caller, who keeps it alive while the store uses it.
+         * Updates of existing nodes are written into the image, which must be writable: a
+         * mapped index file is mapped copy-on-write (MAP_PRIVATE), so they stay private to the
+         * process and are never written back to the file. Adding nodes afterwards moves the
+         * arena into an own allocation first.
+         * @param image Start of the image (64-byte aligned).
+         * @param nodeCount Number of nodes in the image.
+         */
+        void attach(void* image, int nodeCount);
+
+        /**
+         * @return The number of nodes in the image writeImage produces: the nodes in use,
+         * without the released ones.
+         */
+        [[nodiscard]] int imageSize() const;
+
+        /**
+         * @return The id a node in use gets in the image writeImage produces.
+         */
+        [[nodiscard]] int imageNodeId(int nodeId) const;
+
+        /**
+         * @return The size in bytes of the image writeImage produces for the current nodes.
+         */
+        [[nodiscard]] std::size_t imageBytes() const;
+
+        /**
+         * Write the nodes as a position-independent arena image: the node headers followed by
+         * the entry arrays, each 64-byte aligned relative to the start of the image.
+         * Released nodes, level 0, are left out and the nodes in use are renumbered
+         * consecutively in id order, child entries included, so an index that is updated and
+         * saved repeatedly does not keep the slots of its removed nodes.
+         * @param file The file to write to.
+         * @return False if writing failed.
+         */
+        bool writeImage(std::FILE* file) const;
+
+        /**
+         * Create a new, empty node at the end of the arena.
+         * @param level Level of the node within the tree.
+         * @return The id of the new node.
+         */
+        int createNode(int level);
+
+        /**
+         * Return a node to the arena. Its id is reused by the next createNode; the arena
+         * itself never shrinks, but writeImage leaves the node out.
+         * @param nodeId The node to release.
+         */
+        void releaseNode(int nodeId);
+
+        /**
+         * Append count node slots at the end of the arena without initialising them.
+         * Together with initNode this lets a parallel build fill distinct nodes concurrently
+         * while keeping the ids identical to a sequential build.
+         * @param count Number of nodes to append.
+         * @return The id of the first appended node.
+         */
+        int allocateNodes(int count);
+
+        /**
+         * Initialise an allocated node as empty. Safe to call concurrently for distinct ids.
+         * @param nodeId The node to initialise.
+         * @param level Level of the node within the tree.
+         */
+        void initNode(int nodeId, int level);
+
+        /**
+         * Add a child node to an internal node, inlining the child's MBR.
+         * @param nodeId The parent node.
+         * @param childId The child node being added.
+         */
+        void addChildEntry(int nodeId, int childId);
+
+        /**
+         * Add a leaf rectangle to a leaf node.
+         * @param nodeId The leaf node.
+         * @param rect The rectangle being added.
+         */
+        void addLeafEntry(int nodeId, const Rectangle& rect);
+
+        /**
+         * Add a leaf rectangle given by its corners to a leaf node.
+         * @param nodeId The leaf node.
+         * @param min Minimum corner of the rectangle.
+         * @param max Maximum corner of the rectangle.
+         * @param id The id of the rectangle.
+         */
+        void addLeafEntry(int nodeId, const T* min, const T* max, int id);
+
+        /**
+         * Copy the entries of a node, with the child node id as the id of an internal node's entries.
+         * @param nodeId The node.
+         * @param entries Receives the entries, replacing its contents.
+         */
+        void readEntries(int nodeId, std::vector<Rectangle>& entries) const;
+
+        /**
+         * Replace the entries of a node, keeping its level, and recalculate its MBR.
+         * The entries are stored sorted by minX.
+         * @param nodeId The node.
+         * @param entries The new entries, at most capacity().
+         * @param count Number of entries.
+         */
+        void writeEntries(int nodeId, const Rectangle* entries, int count);
+
+        /**
+         * Sort the entries of a node by their minimum X coordinate, the minimum on the first axis.
+         * All coordinate arrays and ids are permuted together.
+         * @param nodeId The node to sort.
+         */
+        void sortEntriesByMinX(int nodeId);
+
+        /**
+         * Delete an entry of a node by index and recalculate the node's MBR.
+         * @param nodeId The node.
+         * @param index Index of the entry to remove.
+         */
+        void deleteEntry(int nodeId, int index);
+
+        /**
+         * Recalculate the subtree count of a node from its entries and the counts of its children,
+         * which must be up to date. writeEntries and deleteEntry do this for the node they change;
+         * its ancestors are left to the caller.
+         * @param nodeId The node.
+         */
+        void recountSubtree(int nodeId);
+
+        /**
+         * Recalculate the minimum bounding rectangle (MBR) of a node from its current entries.
+         * @param nodeId The node.
+         */
+        void recalculateMBR(int nodeId);
+
+        /**
+         * @return The header of the node with the given id.
+         */
+        Node& node(int nodeId) {
+            if constexpr (INLINE) {
+                return *reinterpret_cast<Node*>(static_cast<char*>(m_block) + static_cast<std::size_t>(nodeId) * BLOCK_BYTES);
+            } else {
+                return m_nodes[nodeId];
+            }
+        }
+        [[nodiscard]] const Node& node(int nodeId) const {
+            return const_cast<BasicNodeStore*>(this)->node(nodeId);
+        }
+
+        /**
+         * @return The entry arrays of the node with the given id (32-byte aligned, padded to stride()).
+         */
+        [[nodiscard]] NodeEntries entries(int nodeId) const {
+            NodeEntries e;
+            if constexpr (INLINE) {
+                char* base = static_cast<char*>(m_block) + static_cast<std::size_t>(nodeId) * BLOCK_BYTES + ENTRIES_OFFSET;
+                for (int d = 0; d < D; d++) {
+                    e.min[d] = reinterpret_cast<T*>(base + d * ARRAY_BYTES);
+                    e.max[d] = reinterpret_cast<T*>(base + (D + d) * ARRAY_BYTES);
+                }
+                e.ids = reinterpret_cast<int*>(base + 2 * D * ARRAY_BYTES);
+            } else {
+                const std::size_t offset = static_cast<std::size_t>(nodeId) * m_stride;
+                for (int d = 0; d < D; d++) {
+                    e.min[d] = m_min[d] + offset;
+                    e.max[d] = m_max[d] + offset;
+                }
+                e.ids = m_ids + offset;
+            }
+            return e;
+        }
+
+        /**
+         * @return The number of nodes in the arena.
+         */
+        [[nodiscard]] int size() const { return m_size; }
+
+        /**
+         * @return The number of entry slots per node (capacity rounded up to SIMD_WIDTH).
+         */
+        [[nodiscard]] int stride() const {
+            if constexpr (INLINE) {
+                return INLINE_STRIDE;
+            } else {
+                return m_stride;
+            }
+        }
+
+        /**
+         * @return The bytes per node recorded in an index file: the header for the shared
+         * entry arrays, the whole block for the inline layout.
+         */
+        [[nodiscard]] static constexpr std::size_t nodeBytes() {
+            return INLINE ? BLOCK_BYTES : sizeof(Node);
+        }
+
+        /**
+         * @return The maximum number of entries per node.
+         */
+        [[nodiscard]] int capacity() const { return m_capacity; }
+
+        /**
+         * @return The number of bytes currently allocated by the arena.
+         */
+        [[nodiscard]] std::size_t allocatedBytes() const { return m_blockBytes; }
+
+    private:
+
+        /**
+         * Offsets within a node block of the inline layout: the header, then min[0..D-1],
+         * max[0..D-1] and the ids, each INLINE_STRIDE slots long.
+         */
+        static constexpr std::size_t ENTRIES_OFFSET = (sizeof(Node) + 63) / 64 * 64;
+        static constexpr std::size_t ARRAY_BYTES = INLINE_STRIDE * sizeof(T);
+        static constexpr std::size_t BLOCK_BYTES =
+                (ENTRIES_OFFSET + 2 * D * ARRAY_BYTES + INLINE_STRIDE * sizeof(int) + 63) / 64 * 64;
+
+        /**
+         * Write an entry into the given slot of a node.
+         */
+        void setEntry(const NodeEntries& e, int slot, const T* min, const T* max, int id);
+
+        /**
+         * Turn the given slot of a node into a padding entry: an empty box with id -1.
+         */
+        void clearEntry(const NodeEntries& e, int slot);
+
+        /**
+         * Move the arena into a new block able to hold nodeCount nodes.
+         */
+        void grow(int nodeCount);
+
+        /**
+         * Point the node and entry arrays into a block laid out for nodeCount nodes.
+         */
+        void setBlock(void* block, int nodeCount);
+
+        /**
+         * Release the current block.
+         */
+        void release();
+
+        /**
+         * @return The image id of every node, -1 for a released node.
+         */
+        [[nodiscard]] std::vector<int> imageIds() const;
+
+        const int m_capacity;
+        const int m_stride;
+        const bool m_hugePages;
+
+        int m_size = 0;
+        int m_reserved = 0;
+        std::vector<int> m_freeNodes;
+
+        void* m_block = nullptr;
+        std::size_t m_blockBytes = 0;
+        bool m_mapped = false;
+        bool m_attached = false;
+
+        Node* m_nodes = nullptr;
+        std::array<T*, D> m_min{};
+        std::array<T*, D> m_max{};
+        int* m_ids = nullptr;
+    };
+
+    using NodeStore = BasicNodeStore<2, float>;
+
+}
+
+#endif // NODESTORE_H
@@ -2,36 +2,57 @@
 
 #ifndef POINT_H
 #define POINT_H
+#include <array>
 #include <string>
+#include <type_traits>
 
 namespace rtree {
 
-class Point {
+/**
+ * A point with D coordinates of type T, as used by BasicRTree<D, T>.
+ */
+template<int D, typename T>
+class BasicPoint {
 public:
 
+    static_assert(D >= 1, "A point needs at least one dimension");
+
     /**
-    * The (x, y) coordinates of the point.
+    * The coordinates of the point, one per dimension.
     */
-    float x;
-    float y;
+    std::array<T, D> coords{};
+
+    BasicPoint() = default;
 
     /**
     * Constructor.
     *
-    * @param x The x coordinate of the point
-    * @param y The y coordinate of the point
+    * @param coords The coordinates of the point
     */
-    Point(float x, float y);
+    explicit BasicPoint(const std::array<T, D>& coords) : coords(coords) {}
 
     /**
-    * Copy from another point into this one
+    * Constructor from one coordinate per dimension, e.g. Point(x, y).
     */
-    void set(const Point & other);
+    template<typename... Coords,
+             typename = std::enable_if_t<sizeof...(Coords) == D && (std::is_arithmetic_v<Coords> && ...)>>
+    BasicPoint(Coords... coords) : coords{static_cast<T>(coords)...} {}
+
+    T& operator[](int d) { return coords[d]; }
+    T operator[](int d) const { return coords[d]; }
 
     /**
-    * Print as a string in format "(x, y)"
+    * Print as a string in format "(x, y, ...)"
     */
-    [[nodiscard]] std::string toString() const;
+    [[nodiscard]] std::string toString() const {
+        std::string text = "(";
+        for (int d = 0; d < D; d++) {
+            text += (d > 0 ? "," : "") + std::to_string(coords[d]);
+        }
+        return text + ")";
+    }
 };
+
+using Point = BasicPoint<2, float>;
 }
 #endif // POINT_H
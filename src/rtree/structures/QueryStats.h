@@ -0,0 +1,109 @@
+#pragma once
+
+#ifndef QUERYSTATS_H
+#define QUERYSTATS_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+/**
+ * Compiles a statement that updates the traversal counters only when the library is built
+ * with RTREE_STATS, so the instrumentation costs nothing otherwise. The macro is variadic so
+ * the statement may name templates with several arguments.
+ */
+#ifdef RTREE_STATS
+#define RTREE_STAT(...) __VA_ARGS__
+#else
+#define RTREE_STAT(...)
+#endif
+
+namespace rtree {
+
+    /**
+     * Traversal counters of one query or an aggregate of several.
+     *
+     * The counters are only collected when the library is built with RTREE_STATS;
+     * otherwise they all stay zero.
+     */
+    struct QueryStats {
+        /**
+         * Number of tree levels counted separately; deeper levels share the last counter.
+         */
+        static constexpr int MAX_LEVELS = 16;
+
+        /**
+         * Queries counted. A whole join counts as one query.
+         */
+        uint64_t queries = 0;
+
+        /**
+         * Nodes visited, by node level (1 for the leaves). Join traversals count every
+         * node pair they expand under the level of the node of the first tree.
+         */
+        std::array<uint64_t, MAX_LEVELS> nodesVisited{};
+
+        /**
+         * Node and leaf entries tested against a range, a distance bound or another node.
+         */
+        uint64_t entriesTested = 0;
+
+        /**
+         * Entries and queued nodes discarded by a range, distance bound or join window
+         * without being descended into or returned.
+         */
+        uint64_t entriesPruned = 0;
+
+        /**
+         * Internal nodes answered whole because the query range contains them.
+         */
+        uint64_t containedSubtrees = 0;
+
+        /**
+         * Pushes and pops on the priority queues of the nearest-neighbour searches.
+         */
+        uint64_t heapOperations = 0;
+
+        /**
+         * Node pairs expanded by the joins.
+         */
+        uint64_t nodePairs = 0;
+
+        /**
+         * Ids, neighbours or pairs returned, or entries counted.
+         */
+        uint64_t results = 0;
+
+        /**
+         * @brief Counts a visit of a node.
+         * @param level The level of the node.
+         */
+        void visit(int level) {
+            nodesVisited[std::min(std::max(level, 0), MAX_LEVELS - 1)]++;
+        }
+
+        /**
+         * @return The number of nodes visited on all levels.
+         */
+        [[nodiscard]] uint64_t totalNodesVisited() const {
+            uint64_t total = 0;
+            for (uint64_t count : nodesVisited) total += count;
+            return total;
+        }
+
+        QueryStats& operator+=(const QueryStats& other) {
+            queries += other.queries;
+            for (int i = 0; i < MAX_LEVELS; i++) nodesVisited[i] += other.nodesVisited[i];
+            entriesTested += other.entriesTested;
+            entriesPruned += other.entriesPruned;
+            containedSubtrees += other.containedSubtrees;
+            heapOperations += other.heapOperations;
+            nodePairs += other.nodePairs;
+            results += other.results;
+            return *this;
+        }
+    };
+
+}
+
+#endif // QUERYSTATS_H
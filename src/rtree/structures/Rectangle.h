@@ -3,132 +3,126 @@
 #ifndef RECTANGLE_H
 #define RECTANGLE_H
 
+#include <array>
 #include <string>
-#include <vector>
+#include <type_traits>
 #include "Point.h"
 
 namespace rtree {
 
-class Rectangle {
+/**
+ * Type squared distances between coordinates of type T are computed in: T itself for floating
+ * point coordinates, double for integer ones so that the squares cannot overflow.
+ */
+template<typename T>
+using DistanceType = std::conditional_t<std::is_floating_point_v<T>, T, double>;
+
+/**
+ * An axis-aligned box with D coordinates of type T per corner, as indexed by BasicRTree<D, T>.
+ *
+ * The predicates loop over the dimensions with a bound known at compile time, so they unroll
+ * into the same straight-line code as hand-written ones.
+ */
+template<int D, typename T>
+class BasicRectangle {
 public:
 
-    float minX = 0;
-    float minY = 0;
-    float maxX = 0;
-    float maxY = 0;
+    static_assert(D >= 1, "A rectangle needs at least one dimension");
+
+    using Distance = DistanceType<T>;
+
+    std::array<T, D> min{};
+    std::array<T, D> max{};
     int id = 0;
 
-    std::vector<Point> points;
+    BasicRectangle() = default;
 
     /**
     * Constructor.
     *
-    * @param x1 value of minX
-    * @param y1 value of minY
-    * @param x2 value of maxX
-    * @param y2 value of maxY
-   */
-    Rectangle(float x1, float y1, float x2, float y2, int id);
+    * @param min The minimum corner
+    * @param max The maximum corner
+    * @param id The id of the rectangle
+    */
+    BasicRectangle(const std::array<T, D>& min, const std::array<T, D>& max, int id = 0)
+        : min(min), max(max), id(id) {}
 
     /**
-    * Constructor without id.
+    * Constructor of a two-dimensional rectangle.
     *
     * @param x1 value of minX
     * @param y1 value of minY
     * @param x2 value of maxX
     * @param y2 value of maxY
+    * @param id The id of the rectangle
     */
-    Rectangle(float x1, float y1, float x2, float y2);
+    template<int Dims = D, typename = std::enable_if_t<Dims == 2>>
+    BasicRectangle(T x1, T y1, T x2, T y2, int id = 0) : min{x1, y1}, max{x2, y2}, id(id) {}
 
     /**
-    * Make a copy of this rectangle
-    *
-    * @return copy of this rectangle
+    * Determine whether two boxes, given by their corners, intersect.
     */
-    Rectangle copy() const;
+    static bool intersects(const T* aMin, const T* aMax, const T* bMin, const T* bMax) {
+        bool hit = true;
+        for (int d = 0; d < D; d++) {
+            hit &= (aMax[d] >= bMin[d]) & (aMin[d] <= bMax[d]);
+        }
+        return hit;
+    }
 
     /**
-    * Determine whether the edge of this rectangle overlies the equivalent
-    * edge of the passed rectangle
+    * Determine whether box a, given by its corners, contains box b.
     */
-    bool edgeOverlaps(Rectangle& r) const;
+    static bool contains(const T* aMin, const T* aMax, const T* bMin, const T* bMax) {
+        bool inside = true;
+        for (int d = 0; d < D; d++) {
+            inside &= (aMin[d] <= bMin[d]) & (aMax[d] >= bMax[d]);
+        }
+        return inside;
+    }
 
     /**
-    * Determine whether two rectangles intersect
-    *
-    * @param r1MinX minimum X coordinate of rectangle 1
-    * @param r1MinY minimum Y coordinate of rectangle 1
-    * @param r1MaxX maximum X coordinate of rectangle 1
-    * @param r1MaxY maximum Y coordinate of rectangle 1
-    * @param r2MinX minimum X coordinate of rectangle 2
-    * @param r2MinY minimum Y coordinate of rectangle 2
-    * @param r2MaxX maximum X coordinate of rectangle 2
-    * @param r2MaxY maximum Y coordinate of rectangle 2
-    *
-    * @return true if rectangle intersects range, false otherwise.
+    * Return the squared distance between a box, given by its corners, and a point, with
+    * coordinates of type T or Distance. If the box contains the point, the distance is zero.
     */
-    [[nodiscard]] bool intersects(float rangeMinX, float rangeMinY, float rangeMaxX, float rangeMaxY) const {
-        return maxX >= rangeMinX && minX <= rangeMaxX && maxY >= rangeMinY && minY <= rangeMaxY;
-    }
-
-    static inline bool contains(float r1MinX, float r1MinY, float r1MaxX, float r1MaxY,
-                                 float r2MinX, float r2MinY, float r2MaxX, float r2MaxY) {
-        return r1MaxX >= r2MaxX && r1MinX <= r2MinX && r1MaxY >= r2MaxY && r1MinY <= r2MinY;
+    template<typename Coordinate>
+    static Distance distance(const T* min, const T* max, const Coordinate* p) {
+        Distance total = 0;
+        for (int d = 0; d < D; d++) {
+            const Distance below = static_cast<Distance>(min[d]) - p[d];
+            const Distance above = static_cast<Distance>(p[d]) - max[d];
+            const Distance gap = below > 0 ? below : (above > 0 ? above : 0);
+            total += gap * gap;
+        }
+        return total;
     }
 
     /**
-    * Return the distance between a rectangle and a point.
-    * If the rectangle contains the point, the distance is zero.
-    *
-    * @param minX minimum X coordinate of rectangle
-    * @param minY minimum Y coordinate of rectangle
-    * @param maxX maximum X coordinate of rectangle
-    * @param maxY maximum Y coordinate of rectangle
-    * @param pX X coordinate of point
-    * @param pY Y coordinate of point
-    *
-    * @return distance between this rectangle and the passed point.
+    * Compute the volume of a box, given by its corners: its area in two dimensions.
     */
-    static inline float distance(float minX, float minY,
-                           float maxX, float maxY,
-                           float x, float y) {
-        float dx = 0.0f, dy = 0.0f;
-
-        // Compute horizontal distance
-        if (x < minX) {
-            dx = minX - x;
-        } else if (x > maxX) {
-            dx = x - maxX;
+    static Distance volume(const T* min, const T* max) {
+        Distance total = 1;
+        for (int d = 0; d < D; d++) {
+            total *= static_cast<Distance>(max[d]) - min[d];
         }
+        return total;
+    }
 
-        // Compute vertical distance
-        if (y < minY) {
-            dy = minY - y;
-        } else if (y > maxY) {
-            dy = y - maxY;
-        }
+    [[nodiscard]] bool intersects(const BasicRectangle& r) const {
+        return intersects(min.data(), max.data(), r.min.data(), r.max.data());
+    }
 
-        return (dx * dx) + (dy * dy);
+    [[nodiscard]] bool contains(const BasicRectangle& r) const {
+        return contains(min.data(), max.data(), r.min.data(), r.max.data());
     }
 
-    /**
-    * Compute the area of a rectangle.
-    *
-    * @param minX the minimum X coordinate of the rectangle
-    * @param minY the minimum Y coordinate of the rectangle
-    * @param maxX the maximum X coordinate of the rectangle
-    * @param maxY the maximum Y coordinate of the rectangle
-    *
-    * @return The area of the rectangle
-    */
-    static float area(float minX, float minY, float maxX, float maxY);
+    [[nodiscard]] Distance distance(const BasicPoint<D, T>& p) const {
+        return distance(min.data(), max.data(), p.coords.data());
+    }
 
-    /**
-    * Adds a new point in this rectangle.
-    *
-    * @param p Point to add to this rectangle
-    */
-    void add(Point p);
+    [[nodiscard]] Distance volume() const {
+        return volume(min.data(), max.data());
+    }
 
     /**
     * Determine whether this rectangle is equal to a given rectangle.
@@ -136,44 +130,45 @@ public:
     *
     * @param r The rectangle to compare with this rectangle
     */
-    bool equals(Rectangle& r) const;
-
-    /**
-     * @brief Computes the width of the rectangle.
-     *
-     * @return The width of the rectangle (maxX - minX).
-     */
-    [[nodiscard]] float width() const;
-
-    /**
-     * @brief Computes the height of the rectangle.
-     *
-     * @return The height of the rectangle (maxY - minY).
-     */
-    [[nodiscard]] float height() const;
+    [[nodiscard]] bool equals(const BasicRectangle& r) const {
+        return min == r.min && max == r.max;
+    }
 
     /**
-     * @brief Computes the aspect ratio of the rectangle.
-     *
-     * @return The aspect ratio (width / height).
+     * @brief Computes the extent of the rectangle along an axis: its width for axis 0 and its
+     * height for axis 1.
      */
-    [[nodiscard]] float aspectRatio() const;
+    [[nodiscard]] T extent(int axis) const {
+        return max[axis] - min[axis];
+    }
 
     /**
      * @brief Computes the center point of the rectangle.
      *
-     * @return A Point representing the center of the rectangle.
+     * @return A point representing the center of the rectangle.
      */
-    [[nodiscard]] Point center() const;
+    [[nodiscard]] BasicPoint<D, T> center() const {
+        BasicPoint<D, T> c;
+        for (int d = 0; d < D; d++) {
+            c[d] = (min[d] + max[d]) / 2;
+        }
+        return c;
+    }
 
     /**
      * @brief Generates a string representation of the rectangle.
      *
-     * @return Coordinates of a rectangle.
+     * @return The minimum coordinates followed by the maximum coordinates.
      */
-    [[nodiscard]] std::string toString() const;
-
-
+    [[nodiscard]] std::string toString() const {
+        std::string text = "(";
+        for (int d = 0; d < 2 * D; d++) {
+            text += (d > 0 ? ", " : "") + std::to_string(d < D ? min[d] : max[d - D]);
+        }
+        return text + ")";
+    }
 };
+
+using Rectangle = BasicRectangle<2, float>;
 }
 #endif // RECTANGLE_H
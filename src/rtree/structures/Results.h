@@ -0,0 +1,145 @@
+#pragma once
+
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace rtree {
+
+    /**
+     * A single k-nearest-neighbour result, with the distance in the given type.
+     */
+    template<typename Distance>
+    struct BasicNeighbor {
+        /**
+         * ID of the leaf entry.
+         */
+        int id;
+
+        /**
+         * Squared Euclidean distance between the entry's rectangle and the query point.
+         */
+        Distance distance;
+    };
+
+    using Neighbor = BasicNeighbor<float>;
+
+    /**
+     * An approximate range count with the bounds the true count is guaranteed to lie within.
+     */
+    struct CountEstimate {
+        /**
+         * Entries known to intersect the range.
+         */
+        uint64_t lower;
+
+        /**
+         * Entries that may intersect the range.
+         */
+        uint64_t upper;
+
+        /**
+         * Estimated number of intersecting entries, between lower and upper.
+         */
+        double estimate;
+    };
+
+    /**
+     * Results of a batch of queries in compressed-row form: the results of query i are
+     * values[offsets[i]] .. values[offsets[i + 1] - 1], in the same order a single query returns them.
+     */
+    template<typename T>
+    struct BatchResults {
+        std::vector<uint64_t> offsets;
+        std::vector<T> values;
+
+        /**
+         * @return The number of queries in the batch.
+         */
+        [[nodiscard]] std::size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+        /**
+         * @return The number of results of the given query.
+         */
+        [[nodiscard]] std::size_t count(std::size_t query) const { return offsets[query + 1] - offsets[query]; }
+
+        /**
+         * @return Pointer to the first result of the given query.
+         */
+        [[nodiscard]] const T* results(std::size_t query) const { return values.data() + offsets[query]; }
+    };
+
+    /**
+     * Receives the results of a range query in batches.
+     *
+     * A batch is emitted per visited leaf, so the ids may point directly into the tree's
+     * storage and are only valid for the duration of the call.
+     */
+    class ResultSink {
+    public:
+        virtual ~ResultSink() = default;
+
+        /**
+         * Accept a batch of result ids.
+         * @param ids Pointer to the first id of the batch.
+         * @param count Number of ids in the batch.
+         */
+        virtual void accept(const int* ids, uint32_t count) = 0;
+    };
+
+    /**
+     * Receives the results of a spatial join in batches of (idA, idB) pairs.
+     * The arrays are only valid for the duration of the call.
+     */
+    class JoinSink {
+    public:
+        virtual ~JoinSink() = default;
+
+        /**
+         * Accept a batch of joined pairs: idsA[i] intersects idsB[i].
+         * @param idsA IDs of the entries of the first tree.
+         * @param idsB IDs of the entries of the second tree.
+         * @param count Number of pairs in the batch.
+         */
+        virtual void accept(const int* idsA, const int* idsB, uint32_t count) = 0;
+    };
+
+    /**
+     * Adapts any callable taking (const int* ids, uint32_t count) to a ResultSink.
+     */
+    template<typename Callback>
+    class CallbackSink final : public ResultSink {
+    public:
+        explicit CallbackSink(Callback callback) : m_callback(std::move(callback)) {}
+
+        void accept(const int* ids, uint32_t count) override {
+            m_callback(ids, count);
+        }
+
+    private:
+        Callback m_callback;
+    };
+
+    /**
+     * Adapts any callable taking (const int* idsA, const int* idsB, uint32_t count) to a JoinSink.
+     */
+    template<typename Callback>
+    class CallbackJoinSink final : public JoinSink {
+    public:
+        explicit CallbackJoinSink(Callback callback) : m_callback(std::move(callback)) {}
+
+        void accept(const int* idsA, const int* idsB, uint32_t count) override {
+            m_callback(idsA, idsB, count);
+        }
+
+    private:
+        Callback m_callback;
+    };
+
+}
+
+#endif // RESULTS_H
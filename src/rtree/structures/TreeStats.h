@@ -0,0 +1,124 @@
+#pragma once
+
+#ifndef TREESTATS_H
+#define TREESTATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace rtree {
+
+    /**
+     * Shape of one level of an R-tree.
+     */
+    struct LevelStats {
+        /**
+         * The level; 1 for the leaves.
+         */
+        int level = 0;
+
+        /**
+         * Number of nodes on the level.
+         */
+        uint64_t nodes = 0;
+
+        /**
+         * Number of entries of those nodes.
+         */
+        uint64_t entries = 0;
+
+        /**
+         * Fraction of the entry slots of those nodes that are used.
+         */
+        double fillFactor = 0;
+
+        /**
+         * Sum of the MBR areas of the nodes.
+         */
+        double area = 0;
+
+        /**
+         * Sum of the intersection areas of every pair of nodes with the same parent.
+         */
+        double overlap = 0;
+
+        /**
+         * Sum of the MBR area of each node not covered by any of its entries.
+         */
+        double deadSpace = 0;
+    };
+
+    /**
+     * Shape and memory use of an R-tree, as reported by RTreeBulkLoad::stats().
+     */
+    struct TreeStats {
+        /**
+         * Number of levels; 1 for a tree that is a single leaf.
+         */
+        int height = 0;
+
+        /**
+         * Maximum number of entries per node.
+         */
+        int capacity = 0;
+
+        /**
+         * Number of nodes on all levels.
+         */
+        uint64_t nodes = 0;
+
+        /**
+         * Number of leaf rectangles.
+         */
+        uint64_t entries = 0;
+
+        /**
+         * Fraction of the entry slots of all nodes that are used.
+         */
+        double fillFactor = 0;
+
+        /**
+         * Sums of the per-level area, overlap and dead space.
+         */
+        double area = 0;
+        double overlap = 0;
+        double deadSpace = 0;
+
+        /**
+         * Bytes of the node headers.
+         */
+        std::size_t nodeBytes = 0;
+
+        /**
+         * Bytes of the entry coordinate arrays of the leaves and of the internal nodes.
+         */
+        std::size_t leafArrayBytes = 0;
+        std::size_t internalArrayBytes = 0;
+
+        /**
+         * Bytes of the entry id arrays of all nodes.
+         */
+        std::size_t idArrayBytes = 0;
+
+        /**
+         * Bytes of the entry arrays, included in the three counts above, taken by unused
+         * slots: the free capacity of each node and the padding up to the SIMD width.
+         */
+        std::size_t unusedSlotBytes = 0;
+
+        /**
+         * Bytes held by the node arena, including reserved and released nodes; for a
+         * memory-mapped index, the size of the mapped node image.
+         */
+        std::size_t allocatedBytes = 0;
+
+        /**
+         * Per-level statistics, from the leaves (level 1) to the root.
+         */
+        std::vector<LevelStats> levels;
+    };
+
+}
+
+#endif // TREESTATS_H